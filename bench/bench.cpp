@@ -0,0 +1,393 @@
+// Standalone benchmark for the loader: generates a synthetic mods folder, then drives the exports
+// through a fake recomp_context and rdram the way the game would and reports throughput and tail
+// latency. Built by `make bench`.
+//
+// Compiled as one translation unit with loader.cpp, so the parser can be timed on its own too.
+#include "../src/loader.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+#include "lz4.hpp"
+#include "old_parser.hpp"
+#include "../tests/fake_guest.hpp"
+
+namespace {
+
+struct BenchOptions {
+    size_t files = 3000;
+    // Folder levels between dialog/ and the files.
+    size_t depth = 2;
+    // Fraction of the characters in strings that aren't ASCII.
+    double nonAscii = 0.05;
+    size_t iterations = 10;
+    size_t lookups = 200000;
+    // Threads looking up dialogs while another one refreshes them.
+    size_t readers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    // Where the benchmark creates its own folder; nothing else in it is touched.
+    fs::path dir = fs::temp_directory_path();
+    // The folder the corpus is generated in, a new one under dir.
+    fs::path root;
+    bool keep = false;
+    // Run everything with DialogLoader_SetCompression enabled.
+    bool compress = false;
+};
+
+// Per-operation durations of one benchmark.
+struct Samples {
+    std::vector<int64_t> ns;
+    // Bytes processed in total, for throughput; 0 to report operations per second instead.
+    uint64_t bytes = 0;
+
+    void Report(const char* name) {
+        if (ns.empty()) return;
+        std::sort(ns.begin(), ns.end());
+        int64_t total = 0;
+        for (int64_t sample : ns) total += sample;
+        auto percentile = [&](double fraction) { return ns[std::min(ns.size() - 1, size_t(fraction * ns.size()))]; };
+        auto formatTime = [](int64_t time) {
+            char text[32];
+            if (time < 10000) snprintf(text, sizeof(text), "%lld ns", (long long)time);
+            else if (time < 10000000) snprintf(text, sizeof(text), "%.1f us", time / 1000.0);
+            else snprintf(text, sizeof(text), "%.1f ms", time / 1000000.0);
+            return std::string(text);
+        };
+
+        char throughput[48];
+        if (bytes > 0) snprintf(throughput, sizeof(throughput), "%.1f MB/s", bytes / (total / 1e9) / 1e6);
+        else snprintf(throughput, sizeof(throughput), "%.0f ops/s", ns.size() / (total / 1e9));
+        printf("%-28s %9zu ops %14s  p50 %10s  p99 %10s  p99.9 %10s  max %10s\n", name, ns.size(), throughput,
+            formatTime(percentile(0.5)).c_str(), formatTime(percentile(0.99)).c_str(), formatTime(percentile(0.999)).c_str(),
+            formatTime(ns.back()).c_str());
+    }
+};
+
+template <typename Function>
+int64_t Time(Function&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return ElapsedNs(start);
+}
+
+// Random dialog text: words of a few letters, with nonAscii of the characters replaced by accented
+// letters the game's character set has and, more rarely, characters it doesn't.
+std::string GenerateText(std::mt19937& rng, double nonAscii, size_t maxLength) {
+    static const char* const LATIN1[] = { "é", "è", "ü", "ö", "ß", "ñ", "ç", "À" };
+    static const char* const OTHER[] = { "“", "”", "…", "日", "\U0001F600" };
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::uniform_int_distribution<int> letter('a', 'z');
+    std::uniform_int_distribution<size_t> length(8, maxLength);
+
+    std::string text;
+    size_t target = length(rng);
+    size_t characters = 0;
+    while (characters < target) {
+        if (characters > 0 && chance(rng) < 0.18) {
+            text += ' ';
+        } else if (chance(rng) < nonAscii) {
+            text += chance(rng) < 0.85 ? LATIN1[rng() % std::size(LATIN1)] : OTHER[rng() % std::size(OTHER)];
+        } else {
+            text += char(letter(rng));
+        }
+        characters++;
+    }
+    return text;
+}
+
+std::string GenerateDialog(std::mt19937& rng, double nonAscii) {
+    static const int CMDS[] = { 0x80, 0x81, 0x83, 0x87, 0xFE };
+    std::string contents = "type: Dialog\nbottom:\n";
+    size_t bottom = rng() % 5;
+    for (size_t i = 0; i < bottom; i++) {
+        char line[32];
+        snprintf(line, sizeof(line), "  - { cmd: 0x%X, string: \"", CMDS[rng() % std::size(CMDS)]);
+        contents += line + GenerateText(rng, nonAscii, 120) + "\" }\n";
+    }
+    contents += "top:\n";
+    size_t top = 1 + rng() % 4;
+    for (size_t i = 0; i < top; i++) {
+        contents += "  - { cmd: " + std::to_string(CMDS[rng() % std::size(CMDS)]) + ", string: '" + GenerateText(rng, nonAscii, 80) + "' }\n";
+    }
+    contents += "  - { cmd: 0x04 }\n";
+    return contents;
+}
+
+// Writes options.files dialogs under root/DialogLoader/dialog, spread over options.depth levels of
+// folders. Returns the text IDs and contents, for the benchmarks that don't go through the files.
+std::vector<std::pair<int32_t, std::string>> GenerateCorpus(const BenchOptions& options) {
+    std::mt19937 rng(1234);
+    fs::path dialogPath = options.root / "DialogLoader" / "dialog";
+
+    std::vector<std::pair<int32_t, std::string>> corpus;
+    for (size_t i = 0; i < options.files; i++) {
+        int32_t textId = int32_t(0x0400 + i);
+        fs::path folder = dialogPath;
+        size_t bucket = i;
+        for (size_t level = 0; level < options.depth; level++) {
+            folder /= "level" + std::to_string(level) + "_" + std::to_string(bucket % 4);
+            bucket /= 4;
+        }
+        fs::create_directories(folder);
+
+        std::string contents = GenerateDialog(rng, options.nonAscii);
+        char name[16];
+        snprintf(name, sizeof(name), "%04X.dialog", textId);
+        std::ofstream(folder / name, std::ios::binary) << contents;
+        corpus.emplace_back(textId, std::move(contents));
+    }
+    return corpus;
+}
+
+void RemoveGeneratedFiles(const BenchOptions& options, const char* extension) {
+    for (const AssetFormat* format : { &DIALOG_FORMAT, &QUIZ_Q_FORMAT, &GRUNTY_Q_FORMAT }) {
+        fs::remove(options.root / "DialogLoader" / (std::string(format->folder) + extension));
+    }
+}
+
+void BenchRefreshAll(FakeGuest& guest, const BenchOptions& options) {
+    // Cold compiles everything, warm only parses what the cache doesn't have (nothing), and the
+    // pack skips compiling altogether.
+    Samples cold, cached, packed;
+    for (size_t i = 0; i < options.iterations; i++) {
+        RemoveGeneratedFiles(options, ".pack");
+        RemoveGeneratedFiles(options, ".cache");
+        cold.ns.push_back(Time([&] { guest.Call(DialogLoader_RefreshAll); }));
+        RemoveGeneratedFiles(options, ".pack");
+        cached.ns.push_back(Time([&] { guest.Call(DialogLoader_RefreshAll); }));
+        packed.ns.push_back(Time([&] { guest.Call(DialogLoader_RefreshAll); }));
+    }
+    cold.Report("RefreshAll (cold)");
+    cached.Report("RefreshAll (from .cache)");
+    packed.Report("RefreshAll (from .pack)");
+}
+
+void BenchRefreshDialog(FakeGuest& guest, const BenchOptions& options) {
+    std::mt19937 rng(5);
+    Samples samples;
+    size_t count = std::min<size_t>(options.lookups / 20, 20000);
+    for (size_t i = 0; i < count; i++) {
+        int32_t textId = int32_t(0x0400 + rng() % options.files);
+        samples.ns.push_back(Time([&] { guest.Call(DialogLoader_RefreshDialog, uint32_t(textId)); }));
+    }
+    samples.Report("RefreshDialog");
+}
+
+void BenchGetDialog(FakeGuest& guest, const BenchOptions& options, const char* hitName, const char* missName) {
+    std::mt19937 rng(9);
+    Samples hits, misses;
+    for (size_t i = 0; i < options.lookups; i++) {
+        // One in ten asks for an ID without a replacement, like most of the game's text.
+        bool miss = rng() % 10 == 0;
+        int32_t textId = miss ? int32_t(0x0400 + options.files + rng() % 0x400) : int32_t(0x0400 + rng() % options.files);
+        uint64_t dest = FakeGuest::ToAddress(FakeGuest::BUFFER_ADDRESS);
+        (miss ? misses : hits).ns.push_back(Time([&] { guest.Call(DialogLoader_GetDialog, uint32_t(textId), dest); }));
+    }
+    hits.Report(hitName);
+    misses.Report(missName);
+}
+
+// Readers on their own threads look up dialogs that all have a replacement while a writer keeps
+// refreshing random ones from disk, like Debug Mode does. Every lookup must find its entry: a
+// refresh swaps it for its new version, it never disappears in between.
+void BenchConcurrentLookups(const BenchOptions& options) {
+    std::atomic<bool> stopping{false};
+    std::atomic<size_t> lost{0};
+    std::vector<Samples> readerSamples(options.readers);
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < options.readers; r++) {
+        readers.emplace_back([&, r] {
+            FakeGuest guest;
+            std::mt19937 rng(uint32_t(100 + r));
+            uint64_t dest = FakeGuest::ToAddress(FakeGuest::BUFFER_ADDRESS);
+            for (size_t i = 0; i < options.lookups; i++) {
+                int32_t textId = int32_t(0x0400 + rng() % options.files);
+                uint32_t length = 0;
+                readerSamples[r].ns.push_back(Time([&] { length = guest.Call(DialogLoader_GetDialog, uint32_t(textId), dest); }));
+                if (length == 0) lost++;
+            }
+        });
+    }
+
+    Samples refreshes;
+    std::thread writer([&] {
+        FakeGuest guest;
+        std::mt19937 rng(7);
+        while (!stopping) {
+            int32_t textId = int32_t(0x0400 + rng() % options.files);
+            refreshes.ns.push_back(Time([&] { guest.Call(DialogLoader_RefreshDialog, uint32_t(textId)); }));
+        }
+    });
+
+    for (std::thread& reader : readers) reader.join();
+    stopping = true;
+    writer.join();
+
+    Samples lookups;
+    for (Samples& samples : readerSamples) {
+        lookups.ns.insert(lookups.ns.end(), samples.ns.begin(), samples.ns.end());
+    }
+    std::string name = "GetDialog (" + std::to_string(options.readers) + " readers)";
+    lookups.Report(name.c_str());
+    refreshes.Report("RefreshDialog (concurrent)");
+    if (lost > 0) {
+        printf("%zu lookups found no entry while it was being refreshed\n", lost.load());
+    }
+}
+
+// The streaming compiler against the parser it replaced, on the same files. Both have to produce
+// the same bytes for the comparison to mean anything.
+void BenchParser(const std::vector<std::pair<int32_t, std::string>>& corpus, const BenchOptions& options) {
+    Samples current, old;
+    std::vector<uint8_t> binary;
+    std::vector<uint8_t> oldBinary;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < options.iterations; i++) {
+        for (const auto& [textId, contents] : corpus) {
+            current.ns.push_back(Time([&] { CompileAsset(contents, DIALOG_FORMAT, binary); }));
+            current.bytes += contents.size();
+            old.ns.push_back(Time([&] { oldBinary = OldParser::ConvertDialogToBytes(OldParser::ParseDialog(contents)); }));
+            old.bytes += contents.size();
+            if (i == 0 && binary != oldBinary) mismatches++;
+        }
+    }
+    current.Report("CompileAsset (per file)");
+    old.Report("CompileAsset (old parser)");
+
+    int64_t currentTotal = 0, oldTotal = 0;
+    for (int64_t sample : current.ns) currentTotal += sample;
+    for (int64_t sample : old.ns) oldTotal += sample;
+    printf("The streaming compiler is %.1fx as fast as the old parser\n", currentTotal > 0 ? double(oldTotal) / currentTotal : 0.0);
+    if (mismatches > 0) {
+        printf("%zu files compiled differently from the old parser\n", mismatches);
+    }
+}
+
+void BenchTranscoder(const std::vector<std::pair<int32_t, std::string>>& corpus, const BenchOptions& options) {
+    // The strings of every file back to back, converted in chunks the size of a typical line.
+    std::string text;
+    for (const auto& [textId, contents] : corpus) text += contents;
+    std::vector<uint8_t> output(text.size());
+
+    for (size_t chunkSize : { size_t(48), size_t(4096) }) {
+        Samples samples;
+        for (size_t i = 0; i < options.iterations; i++) {
+            for (size_t offset = 0; offset < text.size(); offset += chunkSize) {
+                size_t length = std::min(chunkSize, text.size() - offset);
+                samples.ns.push_back(Time([&] {
+                    ConvertUTF8ToLatin1(reinterpret_cast<const uint8_t*>(text.data()) + offset, length, output.data() + offset);
+                }));
+                samples.bytes += length;
+            }
+        }
+        std::string name = "UTF-8 -> Latin-1 (" + std::to_string(chunkSize) + " B)";
+        samples.Report(name.c_str());
+    }
+}
+
+// How well compiled dialogs compress on their own, and what unpacking one costs.
+void BenchCompression(const std::vector<std::pair<int32_t, std::string>>& corpus, const BenchOptions& options) {
+    std::vector<std::vector<uint8_t>> binaries(corpus.size());
+    std::vector<std::vector<uint8_t>> compressed(corpus.size());
+    size_t compiledBytes = 0;
+    size_t compressedBytes = 0;
+    for (size_t i = 0; i < corpus.size(); i++) {
+        CompileAsset(corpus[i].second, DIALOG_FORMAT, binaries[i]);
+        compressed[i].resize(LZ4CompressBound(binaries[i].size()));
+        compressed[i].resize(LZ4CompressBlock(binaries[i].data(), binaries[i].size(), compressed[i].data()));
+        compiledBytes += binaries[i].size();
+        compressedBytes += compressed[i].size();
+    }
+
+    Samples samples;
+    std::vector<uint8_t> output(DialogStore::MAX_ENTRY_SIZE);
+    for (size_t i = 0; i < options.iterations; i++) {
+        for (size_t j = 0; j < corpus.size(); j++) {
+            samples.ns.push_back(Time([&] {
+                LZ4DecompressBlock(compressed[j].data(), compressed[j].size(), output.data(), output.size());
+            }));
+            samples.bytes += binaries[j].size();
+        }
+    }
+    samples.Report("LZ4 decompress (per entry)");
+    printf("%zu compiled bytes compress to %zu (%.1f%%)\n", compiledBytes, compressedBytes,
+        compiledBytes > 0 ? 100.0 * compressedBytes / compiledBytes : 0.0);
+}
+
+void PrintUsage() {
+    printf("usage: dialog_bench [--files N] [--depth N] [--non-ascii FRACTION] [--iterations N] [--lookups N]\n"
+        "                    [--readers N] [--dir PATH] [--keep] [--compress]\n");
+}
+
+bool ParseOptions(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--keep" || option == "--compress") {
+            (option == "--keep" ? options.keep : options.compress) = true;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        const char* value = argv[++i];
+        try {
+            if (option == "--files") options.files = std::stoul(value);
+            else if (option == "--depth") options.depth = std::stoul(value);
+            else if (option == "--non-ascii") options.nonAscii = std::stod(value);
+            else if (option == "--iterations") options.iterations = std::max<size_t>(1, std::stoul(value));
+            else if (option == "--lookups") options.lookups = std::stoul(value);
+            else if (option == "--readers") options.readers = std::max<size_t>(1, std::stoul(value));
+            else if (option == "--dir") options.dir = value;
+            else return false;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    // Text IDs are 16 bits, and the lookups ask for IDs past the corpus to time misses.
+    return options.files > 0 && options.files <= 0xF000;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 1;
+    }
+
+    // A folder no one else uses, since the benchmark deletes its contents between runs and all of it
+    // at the end.
+    std::random_device random;
+    do {
+        options.root = options.dir / ("dialogloader-bench-" + std::to_string(random()));
+    } while (!fs::create_directories(options.root));
+
+    printf("Generating %zu dialogs, %zu folders deep, %.0f%% non-ASCII, in %s\n", options.files, options.depth,
+        options.nonAscii * 100, options.root.string().c_str());
+    std::vector<std::pair<int32_t, std::string>> corpus = GenerateCorpus(options);
+
+    FakeGuest guest;
+    guest.Call(DialogLoader_SetModsFolderPath, guest.WriteString(options.root.string()));
+    guest.Call(DialogLoader_SetCompression, options.compress ? 1 : 0);
+
+    BenchRefreshAll(guest, options);
+    // The last RefreshAll served everything from the pack; compile again so lookups hit the store.
+    RemoveGeneratedFiles(options, ".pack");
+    guest.Call(DialogLoader_RefreshAll);
+    BenchGetDialog(guest, options, "GetDialog hit (store)", "GetDialog miss (store)");
+    BenchRefreshDialog(guest, options);
+    BenchConcurrentLookups(options);
+    // The pack written by the compile above is current, so this serves from it.
+    guest.Call(DialogLoader_RefreshAll);
+    BenchGetDialog(guest, options, "GetDialog hit (pack)", "GetDialog miss (pack)");
+    BenchParser(corpus, options);
+    BenchTranscoder(corpus, options);
+    BenchCompression(corpus, options);
+
+    if (options.keep) {
+        printf("Kept the corpus in %s\n", options.root.string().c_str());
+    } else {
+        fs::remove_all(options.root);
+    }
+    return 0;
+}
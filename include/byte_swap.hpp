@@ -0,0 +1,39 @@
+#ifndef __DIALOGLOADER_BYTE_SWAP__
+#define __DIALOGLOADER_BYTE_SWAP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+#endif
+
+// Reverses the bytes of every 4-byte word in place, turning host-order bytes into the layout the
+// guest sees in rdram and back. size must be a multiple of 4.
+inline void SwapWords(uint8_t* data, size_t size) {
+    size_t i = 0;
+#if defined(__x86_64__) || defined(_M_X64)
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        // Swap the halves of each word, then the bytes of each half. SSE2 only, so no pshufb.
+        block = _mm_shufflehi_epi16(_mm_shufflelo_epi16(block, 0xB1), 0xB1);
+        block = _mm_or_si128(_mm_slli_epi16(block, 8), _mm_srli_epi16(block, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), block);
+    }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    for (; i + 16 <= size; i += 16) {
+        vst1q_u8(data + i, vrev32q_u8(vld1q_u8(data + i)));
+    }
+#endif
+    for (; i + 4 <= size; i += 4) {
+        uint32_t word;
+        memcpy(&word, data + i, sizeof(word));
+        word = (word >> 24) | ((word >> 8) & 0xFF00) | ((word << 8) & 0xFF0000) | (word << 24);
+        memcpy(data + i, &word, sizeof(word));
+    }
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef __DIALOGLOADER_DIALOG_CACHE__
+#define __DIALOGLOADER_DIALOG_CACHE__
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compiled bytes of every dialog file from the previous full load, keyed by the file's path relative
+// to the dialog folder. Unlike dialog.pack, which is only usable when nothing changed at all, this
+// lets a load reuse every file that is still the same and only compile the rest.
+class DialogCache {
+public:
+    struct Entry {
+        uint64_t size;
+        int64_t writeTime;
+        // XXH64 of the file contents, so a file whose mtime changed but whose contents didn't (a
+        // checkout, a copy, an editor saving without changes) still isn't recompiled.
+        uint64_t contentHash;
+        std::vector<uint8_t> binary;
+    };
+
+    // Fails, leaving the cache empty, if the binaries in it came from a compiler other than
+    // compilerVersion, as they may not be what compiling the same files gives now.
+    bool Load(const std::filesystem::path& path, uint32_t compilerVersion);
+    // Writes the cache next to path and moves it into place, so a reader never sees a partial file.
+    // With compress, binaries are written LZ4-compressed; Load takes either.
+    bool Save(const std::filesystem::path& path, uint32_t compilerVersion, bool compress = false) const;
+
+    const Entry* Find(const std::string& relativePath) const;
+    void Set(const std::string& relativePath, Entry entry);
+
+    size_t GetEntryCount() const {
+        return entries.size();
+    }
+
+private:
+    std::unordered_map<std::string, Entry> entries;
+};
+
+#endif
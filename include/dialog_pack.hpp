@@ -0,0 +1,109 @@
+#ifndef __DIALOGLOADER_DIALOG_PACK__
+#define __DIALOGLOADER_DIALOG_PACK__
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// FNV-1a, used to fingerprint the dialog folder so a stale pack is never served.
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 0xCBF29CE484222325ull) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// All compiled dialogs of a folder in one file: a header, a table of entries sorted by text ID and
+// a blob holding the compiled bytes of each entry, already in guest byte order. The
+// file is memory-mapped, so serving a dialog is a binary search plus a copy out of the mapping.
+//
+// A compressed pack stores each entry LZ4-compressed, unless that doesn't make it smaller, and
+// serving one decompresses it straight into the destination instead of copying it.
+class DialogPack {
+public:
+    struct Entry {
+        int32_t textId;
+        uint32_t offset;
+        uint32_t length;
+        // Size of the LZ4 block the entry is stored as, 0 if it's stored as it is. Always 0 in
+        // uncompressed packs, where the field used to be reserved.
+        uint32_t compressedLength;
+    };
+
+    DialogPack() = default;
+    ~DialogPack();
+
+    DialogPack(const DialogPack&) = delete;
+    DialogPack& operator=(const DialogPack&) = delete;
+
+    // Maps the pack at path. Fails (and leaves the pack closed) if the file is missing, malformed or
+    // was built from a folder with a different fingerprint.
+    bool Open(const std::filesystem::path& path, uint64_t fingerprint);
+    // Same, whatever fingerprint the pack was built with: for packs compiled ahead of time on
+    // another machine, where the files they came from have different mtimes or aren't there at all.
+    bool Open(const std::filesystem::path& path);
+    void Close();
+
+    bool IsOpen() const {
+        return entries != nullptr;
+    }
+
+    size_t GetEntryCount() const {
+        return entryCount;
+    }
+
+    // Text ID of the entry at index, in ascending order, for listing what the pack holds.
+    int32_t GetTextId(size_t index) const {
+        return entries[index].textId;
+    }
+
+    // Bytes of the file that are mapped, whether or not they were read yet.
+    size_t GetMappedSize() const {
+        return size;
+    }
+
+    // Whether the pack was written with compress set.
+    bool IsCompressed() const {
+        return compressed;
+    }
+
+    // Copies the compiled bytes for textId into dest, decompressing them if needed, and returns
+    // their size rounded up to whole words and capped at capacity. dest may be null to only query
+    // the size. Returns 0 if the pack doesn't have textId, or its entry doesn't decompress.
+    uint32_t Read(int32_t textId, uint8_t* dest, uint32_t capacity) const;
+    // Returns the bytes textId is stored as in the mapping, compressed or not, or nullptr if the pack
+    // doesn't have it. For faulting an entry in before it's read.
+    const uint8_t* FindStored(int32_t textId, uint32_t& storedLength) const;
+
+    // Stops serving textId from the pack, e.g. because Debug Mode refreshed it from its source.
+    void Hide(int32_t textId);
+
+    // Writes a new pack next to path and moves it into place, so a reader never sees a partial file.
+    // Entries with identical bytes share one copy in the blob.
+    static bool Write(const std::filesystem::path& path, uint64_t fingerprint,
+        const std::vector<std::pair<int32_t, const std::vector<uint8_t>*>>& binaries, bool compress = false);
+
+private:
+    bool Open(const std::filesystem::path& path, const uint64_t* fingerprint);
+    const Entry* FindEntry(int32_t textId) const;
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const Entry* entries = nullptr;
+    size_t entryCount = 0;
+    const uint8_t* blob = nullptr;
+    bool compressed = false;
+    std::unique_ptr<std::atomic<uint8_t>[]> hidden;
+
+#if defined(_WIN32)
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef __DIALOGLOADER_DIALOG_STATS__
+#define __DIALOGLOADER_DIALOG_STATS__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Distribution of durations in nanoseconds. Every power of two is split into 8 linear buckets, so a
+// percentile is accurate to within 12.5% over the whole range, and recording one is a couple of bit
+// operations and a relaxed atomic add: cheap enough for every lookup.
+class LatencyHistogram {
+public:
+    static constexpr size_t SUB_BUCKET_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    // Plain copy of a histogram, or the sum of several, to compute percentiles from.
+    struct Snapshot {
+        std::array<uint64_t, BUCKET_COUNT> buckets{};
+        uint64_t count = 0;
+        uint64_t total = 0;
+        uint64_t max = 0;
+
+        // Upper bound of the smallest bucket that holds at least fraction of the samples, 0 if
+        // there are none.
+        uint64_t GetPercentile(double fraction) const;
+    };
+
+    void Record(uint64_t ns) {
+        buckets[GetBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t previous = max.load(std::memory_order_relaxed);
+        while (ns > previous && !max.compare_exchange_weak(previous, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t GetCount() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    // Adds this histogram's samples to snapshot. Samples recorded meanwhile may or may not be included.
+    void AddTo(Snapshot& snapshot) const;
+
+    static size_t GetBucket(uint64_t value) {
+        if (value < SUB_BUCKETS) return size_t(value);
+        size_t magnitude = size_t(63 - __builtin_clzll(value));
+        return ((magnitude - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) |
+            size_t((value >> (magnitude - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    }
+
+    // Largest value that falls into bucket.
+    static uint64_t GetBucketLimit(size_t bucket);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> max{0};
+};
+
+// Appends a line produced by a callback to a file at a fixed interval, on its own thread.
+class PeriodicLog {
+public:
+    using Formatter = std::function<std::string()>;
+
+    PeriodicLog() = default;
+    ~PeriodicLog();
+
+    PeriodicLog(const PeriodicLog&) = delete;
+    PeriodicLog& operator=(const PeriodicLog&) = delete;
+
+    // Restarts the log with the new settings. The first line is written after one interval.
+    void Start(const std::filesystem::path& path, std::chrono::seconds interval, Formatter formatter);
+    void Stop();
+
+private:
+    void Run(std::filesystem::path path, std::chrono::seconds interval, Formatter formatter);
+
+    std::thread thread;
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+    bool stopping = false;
+};
+
+#endif
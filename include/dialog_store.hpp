@@ -0,0 +1,274 @@
+#ifndef __DIALOGLOADER_DIALOG_STORE__
+#define __DIALOGLOADER_DIALOG_STORE__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "epoch_reclaimer.hpp"
+
+// Compiled dialogs keyed by text ID. Each shard finds its entries through an open-addressing table
+// of (textId, blob), and every distinct compiled entry is stored once, in a blob shared by all the
+// IDs that compile to the same bytes (generic lines, repeated quiz answers), so an entry costs its
+// real size instead of a fixed 4 KiB slot, and a repeated one costs nothing more. Blobs are packed
+// into arena chunks rather than allocated one by one.
+//
+// Lookups take no lock at all. Blobs are immutable and tables never move a slot once it's in use;
+// writers (the background loader, Debug Mode refreshes, language switches) swap the blob pointer of
+// a slot, or publish a whole new table, with atomic stores, and hand whatever they replaced to the
+// EpochReclaimer, which destroys it once no lookup can still be copying out of it. Writers are
+// serialized per shard, so a refresh only ever waits on a writer of the same shard.
+//
+// In compressed mode (SetCompression), each distinct entry is kept LZ4-compressed, and Get
+// decompresses it straight into the destination instead of copying it.
+//
+// With a memory budget, each shard evicts entries with the CLOCK policy once its entries outgrow its
+// share of the budget. Evicted IDs are remembered, so the caller can tell "evicted, bring it back
+// from the source" apart from "there is no replacement".
+class DialogStore {
+public:
+    // Size of the buffer the game reads a text entry into; anything longer is truncated.
+    static constexpr uint32_t MAX_ENTRY_SIZE = 0x1000;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+    };
+
+    DialogStore() = default;
+    ~DialogStore();
+
+    DialogStore(const DialogStore&) = delete;
+    DialogStore& operator=(const DialogStore&) = delete;
+
+    // Copies the entry into dest and stores its size in length. Sizes are always padded to a whole
+    // number of words, since guest memory is accessed in byte-swapped 4-byte units. dest may be null
+    // to only query the size.
+    bool Get(int32_t textId, uint8_t* dest, uint32_t& length) const;
+    // Calls visit(i, data, length) for each textIds[i] in order, with data null if there is no
+    // entry. data stays valid until visit returns. Entries set while the batch runs may or may not
+    // be seen, each one either whole or not at all.
+    template <typename Visit>
+    void GetBatch(const int32_t* textIds, size_t count, Visit&& visit) const;
+    void Set(int32_t textId, const uint8_t* data, size_t size);
+    void Set(int32_t textId, const std::vector<uint8_t>& binary) {
+        Set(textId, binary.data(), binary.size());
+    }
+    void Erase(int32_t textId);
+    void Clear();
+
+    // Replaces the whole contents. The new tables are built before any shard is touched and then
+    // published one shard after the other; every lookup sees either the old or the new entry.
+    void Replace(const std::vector<std::pair<int32_t, const std::vector<uint8_t>*>>& binaries);
+    // Like Replace, but every ID starts out evicted, for a caller that would rather compile each
+    // entry the first time it's asked for. Doesn't count as evictions in the stats.
+    void ReplaceEvicted(const std::vector<int32_t>& textIds);
+
+    // Caps the bytes held by entries, 0 for no limit. Takes effect right away.
+    void SetBudget(size_t bytes);
+    // Whether entries set from now on are stored compressed. Entries that don't get any smaller
+    // are stored as they are. Those already stored stay the way they are until they're replaced.
+    void SetCompression(bool enabled);
+    // Whether textId had an entry that was evicted to stay within the budget.
+    bool WasEvicted(int32_t textId) const;
+    // Puts an evicted entry back. Does nothing if it was set or erased since it was evicted, as the
+    // caller's copy is then out of date. Returns whether it was stored.
+    bool Restore(int32_t textId, const std::vector<uint8_t>& binary);
+
+    size_t GetEntryCount() const;
+    // Distinct blobs behind those entries.
+    size_t GetDistinctCount() const;
+    // Bytes held by the blobs and tables.
+    size_t GetResidentBytes() const;
+    Stats GetStats() const;
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    // One distinct compiled entry, padded to whole words, with its bytes right after it: as they
+    // are, or compressed.
+    struct Blob {
+        // Of the uncompressed bytes.
+        uint64_t hash;
+        // Size of the entry, and of the bytes that follow.
+        uint32_t length;
+        uint32_t storedLength;
+        // Slots pointing at it. Guarded by the pool's mutex; once it drops to 0 the blob is retired.
+        uint32_t references;
+        bool compressed;
+
+        const uint8_t* GetData() const {
+            return reinterpret_cast<const uint8_t*>(this + 1);
+        }
+
+        // Copies the entry into dest, which has room for length bytes.
+        void CopyTo(uint8_t* dest) const;
+    };
+
+    // Every blob of the store, found by hash when interning, cut out of 16 KiB chunks. Blobs never
+    // move, as lookups copy out of them without a lock; instead the space of a released blob is freed
+    // once no lookup can still be reading it and merged with the free space around it, new blobs take
+    // the smallest free range they fit in, and a chunk with nothing left in it is given back. Only
+    // writers take its mutex.
+    class BlobPool {
+    public:
+        BlobPool();
+        ~BlobPool() = default;
+
+        BlobPool(const BlobPool&) = delete;
+        BlobPool& operator=(const BlobPool&) = delete;
+
+        // Returns a blob with these bytes, with a reference for the caller. Compressing happens
+        // before the pool is locked.
+        const Blob* Intern(const uint8_t* data, uint32_t size, bool compress);
+        // Drops a reference. A blob nothing refers to anymore is held until RetireReleased.
+        void Release(const Blob* blob);
+        // Hands the blobs released since the last call to the EpochReclaimer in one batch, which
+        // frees their space once lookups are done with them, and reclaims right away once a chunk's
+        // worth is waiting. Writers call it when they're done.
+        void RetireReleased();
+
+        size_t GetCount() const;
+        // Bytes of the chunks, free space included.
+        size_t GetBytes() const;
+
+    private:
+        struct Arena;
+        // Shared with the batches of released blobs still waiting in the EpochReclaimer, which may
+        // outlive the pool.
+        std::shared_ptr<Arena> arena;
+    };
+
+    // A slot's textId is written once, before its state leaves SLOT_EMPTY, and never changes: an
+    // erased slot is only ever reused for the same ID, the rest wait for the table to be rebuilt.
+    struct Slot {
+        std::atomic<int32_t> textId;
+        std::atomic<uint32_t> state;
+        // Null unless the slot is used.
+        std::atomic<const Blob*> blob;
+    };
+
+    // Fixed capacity; replaced as a whole when it fills up. Lookups only call the const methods,
+    // the rest belong to the shard's writer.
+    class Table {
+    public:
+        explicit Table(size_t capacity);
+
+        // The slot textId was last stored in, whatever its state, or null.
+        const Slot* Find(int32_t textId) const;
+
+        // Gives the entry a second chance the next time the clock hand passes it.
+        void MarkReferenced(const Slot& slot) const {
+            referenced[&slot - slots.get()].store(1, std::memory_order_relaxed);
+        }
+
+        // Takes over the caller's reference to blob. Returns false, and changes nothing, if the
+        // table has to be rebuilt to make room.
+        bool Set(int32_t textId, const Blob* blob, BlobPool& pool);
+        // Adds textId as an evicted entry to a table that doesn't have it yet and isn't published.
+        bool AddEvicted(int32_t textId);
+        void Erase(int32_t textId, BlobPool& pool);
+        // Evicts entries until they fit in budget bytes and returns how many were evicted.
+        size_t Evict(size_t budget, BlobPool& pool);
+        // Gives back every blob the table still points at, once it's been unpublished.
+        void ReleaseAll(BlobPool& pool);
+        // A table with room for the live and evicted entries of this one and as many more, holding
+        // the same blob references. This one is then retired without releasing them.
+        std::unique_ptr<Table> Rebuild() const;
+
+        size_t GetEntryCount() const {
+            return live;
+        }
+
+        size_t GetResidentBytes() const {
+            return sizeof(Table) + capacity * (sizeof(Slot) + sizeof(std::atomic<uint8_t>));
+        }
+
+    private:
+        Slot* FindSlot(int32_t textId) const;
+        // Turns a used slot into an evicted or erased one and drops its blob.
+        void Drop(Slot& slot, uint32_t state, BlobPool& pool);
+
+        size_t capacity;
+        std::unique_ptr<Slot[]> slots;
+        // Set by lookups.
+        std::unique_ptr<std::atomic<uint8_t>[]> referenced;
+        size_t live = 0;
+        size_t evicted = 0;
+        // Slots that aren't empty, erased ones included.
+        size_t occupied = 0;
+        // Bytes the live entries are stored in, counting shared blobs once per entry: the budget caps
+        // what the entries would cost without sharing, but with compression.
+        size_t liveBytes = 0;
+        size_t clockHand = 0;
+    };
+
+    struct alignas(64) Shard {
+        // Serializes the shard's writers, and lets the stats read a table that isn't changing.
+        mutable std::mutex writeMutex;
+        // Null until the first entry.
+        std::atomic<Table*> table{nullptr};
+    };
+
+    static size_t GetShardIndex(int32_t textId);
+    const Blob* Intern(const uint8_t* data, size_t size);
+    // Sets an entry with the shard's writeMutex held, rebuilding its table if it's full.
+    void SetLocked(Shard& shard, int32_t textId, const Blob* blob);
+    // Publishes table in place of the shard's current one, with its writeMutex held, and retires
+    // the old one. Its blob references are released unless table took them over.
+    void Publish(Shard& shard, std::unique_ptr<Table> table, bool releaseOld);
+    using Tables = std::array<std::unique_ptr<Table>, SHARD_COUNT>;
+    // Empty tables sized for the text IDs of entries, null for the shards that get none.
+    template <typename Entries, typename GetTextId>
+    static Tables CreateTables(const Entries& entries, GetTextId getTextId);
+    // Publishes a whole new set of tables, releasing the old entries.
+    void PublishAll(Tables& tables);
+    // The table of textId's shard for lookups, which must hold an EpochReclaimer::Guard while they
+    // use it.
+    const Table* Load(int32_t textId) const {
+        return shards[GetShardIndex(textId)].table.load(std::memory_order_acquire);
+    }
+
+    // Declared first so it outlives the shards' references into it.
+    BlobPool pool;
+    std::array<Shard, SHARD_COUNT> shards;
+    // Per shard, 0 for no limit.
+    std::atomic<size_t> shardBudget{0};
+    std::atomic<bool> compression{false};
+    mutable std::atomic<uint64_t> hits{0};
+    mutable std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+};
+
+template <typename Visit>
+void DialogStore::GetBatch(const int32_t* textIds, size_t count, Visit&& visit) const {
+    EpochReclaimer::Guard guard;
+    // Where compressed entries are unpacked for visit.
+    alignas(4) uint8_t unpacked[MAX_ENTRY_SIZE];
+    for (size_t i = 0; i < count; i++) {
+        const Table* table = Load(textIds[i]);
+        const Slot* slot = table != nullptr ? table->Find(textIds[i]) : nullptr;
+        const Blob* blob = slot != nullptr ? slot->blob.load(std::memory_order_acquire) : nullptr;
+        if (blob != nullptr) {
+            table->MarkReferenced(*slot);
+            hits.fetch_add(1, std::memory_order_relaxed);
+            if (blob->compressed) {
+                blob->CopyTo(unpacked);
+                visit(i, static_cast<const uint8_t*>(unpacked), blob->length);
+            } else {
+                visit(i, blob->GetData(), blob->length);
+            }
+        } else {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            visit(i, static_cast<const uint8_t*>(nullptr), uint32_t(0));
+        }
+    }
+}
+
+#endif
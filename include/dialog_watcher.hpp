@@ -0,0 +1,77 @@
+#ifndef __DIALOGLOADER_DIALOG_WATCHER__
+#define __DIALOGLOADER_DIALOG_WATCHER__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Watches one or more folder trees on a background thread and reports files that were created,
+// modified or removed. Uses inotify on Linux and falls back to polling the trees elsewhere. Either
+// way changes are confirmed against a snapshot of every file's size and mtime, so an editor touching
+// a file without changing it, or a burst of events for one save, is reported at most once.
+class DialogWatcher {
+public:
+    // Called on the watcher thread with every path that changed since the last call. A path that
+    // no longer exists was removed.
+    using Callback = std::function<void(const std::vector<std::filesystem::path>& changed)>;
+
+    DialogWatcher() = default;
+    ~DialogWatcher();
+
+    DialogWatcher(const DialogWatcher&) = delete;
+    DialogWatcher& operator=(const DialogWatcher&) = delete;
+
+    // Watches every root that is a folder. Fails if none is.
+    bool Start(const std::vector<std::filesystem::path>& roots, Callback callback);
+    bool Start(const std::filesystem::path& root, Callback callback) {
+        return Start(std::vector<std::filesystem::path>{ root }, std::move(callback));
+    }
+    void Stop();
+
+    bool IsRunning() const {
+        return running;
+    }
+
+private:
+    struct FileState {
+        uintmax_t size;
+        std::filesystem::file_time_type writeTime;
+    };
+
+    void Run();
+    void RunPolling();
+#if defined(__linux__)
+    void RunInotify();
+    void AddWatches(const std::filesystem::path& dir);
+#endif
+
+    // Re-reads everything under dir and appends whatever differs from the snapshot to changed.
+    void ScanTree(const std::filesystem::path& dir, std::vector<std::filesystem::path>& changed);
+    // Same as ScanTree, for a single file.
+    void CheckFile(const std::filesystem::path& filePath, std::vector<std::filesystem::path>& changed);
+    void Report(std::vector<std::filesystem::path>& changed);
+
+    std::vector<std::filesystem::path> roots;
+    Callback callback;
+    std::map<std::string, FileState> files;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+    bool stopping = false;
+
+#if defined(__linux__)
+    int inotifyFd = -1;
+    int stopPipe[2] = { -1, -1 };
+    std::map<int, std::filesystem::path> watches;
+#endif
+};
+
+#endif
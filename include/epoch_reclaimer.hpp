@@ -0,0 +1,83 @@
+#ifndef __DIALOGLOADER_EPOCH_RECLAIMER__
+#define __DIALOGLOADER_EPOCH_RECLAIMER__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Epoch-based reclamation, so lookups can read shared structures without any lock while writers
+// replace them. A reader marks itself active with a Guard for as long as it uses what it loaded;
+// a writer unlinks an object and hands it to Retire, and it's destroyed once every reader that was
+// active at that point has left. Readers only ever store to their own slot, so the cost of a Guard
+// is one uncontended atomic exchange.
+//
+// There is a single instance, shared by every store and loader.
+class EpochReclaimer {
+public:
+    // Threads that can be inside a Guard at the same time. Slots are handed back when a thread
+    // exits, so this only has to cover the game thread, the pool and the watchers.
+    static constexpr size_t MAX_READERS = 128;
+
+    // Keeps everything loaded while it's alive from being destroyed. Guards can be nested.
+    class Guard {
+    public:
+        Guard() {
+            Get().Enter();
+        }
+        ~Guard() {
+            Get().Exit();
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    static EpochReclaimer& Get();
+
+    // Destroys object with destroy once no reader can still see it. object must already be
+    // unreachable for new readers.
+    void Retire(void* object, void (*destroy)(void*));
+
+    template <typename T>
+    void Retire(T* object) {
+        Retire(const_cast<void*>(static_cast<const void*>(object)), [](void* retired) { delete static_cast<T*>(retired); });
+    }
+
+    // Destroys whatever every reader has moved past. Retire calls it every so often; writers that
+    // just retired something big can call it to not wait for that.
+    void Reclaim();
+
+    // Objects retired but not destroyed yet.
+    size_t GetPendingCount() const;
+
+private:
+    struct alignas(64) ReaderSlot {
+        // Epoch the reader entered at, 0 while it isn't inside a Guard.
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<bool> claimed{false};
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    EpochReclaimer() = default;
+
+    void Enter();
+    void Exit();
+    ReaderSlot& ClaimSlot();
+    // Moves the global epoch forward if every active reader has caught up with it.
+    void TryAdvance();
+
+    std::atomic<uint64_t> globalEpoch{1};
+    ReaderSlot slots[MAX_READERS];
+
+    mutable std::mutex retiredMutex;
+    std::vector<Retired> retired;
+};
+
+#endif
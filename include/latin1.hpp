@@ -0,0 +1,19 @@
+#ifndef __DIALOGLOADER_LATIN1__
+#define __DIALOGLOADER_LATIN1__
+
+#include <cstddef>
+#include <cstdint>
+
+// Converts UTF-8 text to ISO-8859-1, the game's character set, and returns the number of bytes
+// written. Anything that has no Latin-1 equivalent, or isn't valid UTF-8, becomes a '?'. The output
+// is never longer than the input, so output must have room for length bytes.
+//
+// Runs of ASCII, which is nearly all of a translation, are copied 16 or 32 bytes at a time (SSE2 or
+// AVX2 on x86-64, NEON on ARM64); only multibyte sequences go through the byte-by-byte decoder.
+size_t ConvertUTF8ToLatin1(const uint8_t* input, size_t length, uint8_t* output);
+
+// The same conversion one byte at a time, without the vector paths. Gives the same result as
+// ConvertUTF8ToLatin1; tests check the vector paths against it.
+size_t ConvertUTF8ToLatin1Scalar(const uint8_t* input, size_t length, uint8_t* output);
+
+#endif
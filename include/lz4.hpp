@@ -0,0 +1,26 @@
+#ifndef __DIALOGLOADER_LZ4__
+#define __DIALOGLOADER_LZ4__
+
+#include <cstddef>
+#include <cstdint>
+
+// LZ4 block format (no frame, no checksums), for storing compiled entries compressed in the store,
+// the .pack and the .cache. Compiled text is full of repeated control bytes, padding and common
+// words, and decoding is a handful of copies, so an entry costs a few hundred nanoseconds to unpack.
+// Output is compatible with the reference implementation, but the compressor is a plain greedy one.
+
+// Most bytes LZ4CompressBlock can write for length bytes of input.
+constexpr size_t LZ4CompressBound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+// Compresses input into output, which must have room for LZ4CompressBound(length) bytes, and
+// returns the compressed size. Inputs over 64 KiB compress worse but still decode fine.
+size_t LZ4CompressBlock(const uint8_t* input, size_t length, uint8_t* output);
+
+// Decompresses a block into output and returns the number of bytes written. Stops once capacity
+// bytes are written, so a destination smaller than the whole entry gets its beginning. Returns
+// SIZE_MAX if the block is malformed; nothing is ever read or written out of bounds.
+size_t LZ4DecompressBlock(const uint8_t* input, size_t length, uint8_t* output, size_t capacity);
+
+#endif
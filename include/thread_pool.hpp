@@ -0,0 +1,172 @@
+#ifndef __DIALOGLOADER_THREAD_POOL__
+#define __DIALOGLOADER_THREAD_POOL__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small work-stealing pool. Every worker owns a deque: it pops its own tasks from the front and,
+// once that runs dry, steals from the back of the other workers' deques, so a few slow files
+// (long dialogs, cold disk) don't leave the rest of the cores idle at the end of a batch.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount = std::max(1u, std::thread::hardware_concurrency())) {
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < threadCount; i++) {
+            threads.emplace_back([this, i] { WorkerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetThreadCount() const {
+        return threads.size();
+    }
+
+    void Submit(std::function<void()> task) {
+        size_t index = nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            pending++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(workers[index]->mutex);
+            workers[index]->tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // Runs fn(i) for every i in [0, count) and returns once all of them finished. The calling thread
+    // works through the chunks too instead of sleeping, so this also works when called from inside a
+    // pool task. It only ever runs chunks of this call, never other queued tasks: a caller holding a
+    // lock can't end up running a task that waits for the same lock.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& fn) {
+        if (count == 0) return;
+
+        size_t chunkCount = std::min(count, workers.size() * 8);
+        auto batch = std::make_shared<Batch>();
+        batch->fn = &fn;
+        batch->count = count;
+        batch->chunkSize = (count + chunkCount - 1) / chunkCount;
+        batch->chunkCount = (count + batch->chunkSize - 1) / batch->chunkSize;
+
+        // Helpers that start after every chunk was claimed return right away; the batch is shared so
+        // they can still look at it after this returned.
+        size_t helpers = std::min(workers.size(), batch->chunkCount - 1);
+        for (size_t i = 0; i < helpers; i++) {
+            Submit([batch] { RunChunks(*batch); });
+        }
+        RunChunks(*batch);
+
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->done.wait(lock, [&] { return batch->finished == batch->chunkCount; });
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    // One ParallelFor call. Chunks are claimed from next by the caller and its helpers alike, so
+    // whoever is free takes the next one and a few slow chunks don't hold up the rest.
+    struct Batch {
+        const std::function<void(size_t)>* fn = nullptr;
+        size_t count = 0;
+        size_t chunkSize = 0;
+        size_t chunkCount = 0;
+        std::atomic<size_t> next{0};
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t finished = 0;
+    };
+
+    static void RunChunks(Batch& batch) {
+        while (true) {
+            size_t chunk = batch.next.fetch_add(1, std::memory_order_relaxed);
+            if (chunk >= batch.chunkCount) return;
+            // fn is only touched for a claimed chunk, while ParallelFor is still waiting for it.
+            size_t end = std::min(batch.count, (chunk + 1) * batch.chunkSize);
+            for (size_t i = chunk * batch.chunkSize; i < end; i++) {
+                (*batch.fn)(i);
+            }
+            std::lock_guard<std::mutex> lock(batch.mutex);
+            if (++batch.finished == batch.chunkCount) {
+                batch.done.notify_all();
+            }
+        }
+    }
+
+    bool TryPop(size_t self, std::function<void()>& task) {
+        {
+            Worker& own = *workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                TakePending();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < workers.size(); offset++) {
+            Worker& victim = *workers[(self + offset) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                TakePending();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void TakePending() {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        pending--;
+    }
+
+    void WorkerLoop(size_t index) {
+        std::function<void()> task;
+        while (true) {
+            if (TryPop(index, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || pending > 0; });
+            if (stopping) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> nextWorker{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    size_t pending = 0;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "dialog_cache.hpp"
+
+#include <cstring>
+#include <fstream>
+
+#include "lz4.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char CACHE_MAGIC[4] = { 'D', 'L', 'C', 'C' };
+// Versions 1 and 2 didn't record the compiler version and are discarded.
+constexpr uint32_t CACHE_VERSION = 3;
+// Each binary's length is followed by the length of its LZ4 block, 0 if it's stored as it is.
+constexpr uint32_t COMPRESSED_CACHE_VERSION = 4;
+constexpr uint32_t MAX_BINARY_LENGTH = 0x10000;
+
+template <typename T>
+bool ReadValue(std::istream& stream, T& value) {
+    return bool(stream.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <typename T>
+void WriteValue(std::ostream& stream, const T& value) {
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+}
+
+bool DialogCache::Load(const fs::path& path, uint32_t compilerVersion) {
+    entries.clear();
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    char magic[4];
+    uint32_t version;
+    uint32_t fileCompilerVersion;
+    uint32_t count;
+    if (!file.read(magic, sizeof(magic)) || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+        !ReadValue(file, version) || (version != CACHE_VERSION && version != COMPRESSED_CACHE_VERSION) ||
+        !ReadValue(file, fileCompilerVersion) || fileCompilerVersion != compilerVersion || !ReadValue(file, count)) {
+        return false;
+    }
+
+    entries.reserve(count);
+    std::vector<uint8_t> compressed;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t pathLength;
+        uint32_t binaryLength;
+        uint32_t compressedLength = 0;
+        std::string relativePath;
+        Entry entry;
+        if (!ReadValue(file, pathLength) || pathLength > 0x1000) break;
+        relativePath.resize(pathLength);
+        if (!file.read(relativePath.data(), pathLength) || !ReadValue(file, entry.size) ||
+            !ReadValue(file, entry.writeTime) || !ReadValue(file, entry.contentHash) ||
+            !ReadValue(file, binaryLength) || binaryLength > MAX_BINARY_LENGTH ||
+            (version == COMPRESSED_CACHE_VERSION && !ReadValue(file, compressedLength)) || compressedLength > LZ4CompressBound(MAX_BINARY_LENGTH)) {
+            break;
+        }
+        entry.binary.resize(binaryLength);
+        if (compressedLength == 0) {
+            if (!file.read(reinterpret_cast<char*>(entry.binary.data()), binaryLength)) break;
+        } else {
+            compressed.resize(compressedLength);
+            if (!file.read(reinterpret_cast<char*>(compressed.data()), compressedLength) ||
+                LZ4DecompressBlock(compressed.data(), compressedLength, entry.binary.data(), binaryLength) != binaryLength) {
+                break;
+            }
+        }
+        entries.emplace(std::move(relativePath), std::move(entry));
+    }
+
+    // A truncated cache is just a smaller cache, but one that doesn't parse at all is useless.
+    if (entries.size() != count) {
+        entries.clear();
+        return false;
+    }
+    return true;
+}
+
+bool DialogCache::Save(const fs::path& path, uint32_t compilerVersion, bool compress) const {
+    fs::path tempPath = path;
+    tempPath += ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+
+        file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        WriteValue(file, compress ? COMPRESSED_CACHE_VERSION : CACHE_VERSION);
+        WriteValue(file, compilerVersion);
+        WriteValue(file, uint32_t(entries.size()));
+        std::vector<uint8_t> compressed;
+        for (const auto& [relativePath, entry] : entries) {
+            WriteValue(file, uint32_t(relativePath.size()));
+            file.write(relativePath.data(), std::streamsize(relativePath.size()));
+            WriteValue(file, entry.size);
+            WriteValue(file, entry.writeTime);
+            WriteValue(file, entry.contentHash);
+            WriteValue(file, uint32_t(entry.binary.size()));
+            if (!compress) {
+                file.write(reinterpret_cast<const char*>(entry.binary.data()), std::streamsize(entry.binary.size()));
+                continue;
+            }
+
+            compressed.resize(LZ4CompressBound(entry.binary.size()));
+            compressed.resize(LZ4CompressBlock(entry.binary.data(), entry.binary.size(), compressed.data()));
+            const std::vector<uint8_t>& stored = compressed.size() < entry.binary.size() ? compressed : entry.binary;
+            WriteValue(file, uint32_t(&stored == &compressed ? compressed.size() : 0));
+            file.write(reinterpret_cast<const char*>(stored.data()), std::streamsize(stored.size()));
+        }
+        if (!file) return false;
+    }
+
+    std::error_code ec;
+    fs::rename(tempPath, path, ec);
+    if (ec) {
+        fs::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+const DialogCache::Entry* DialogCache::Find(const std::string& relativePath) const {
+    auto it = entries.find(relativePath);
+    return it == entries.end() ? nullptr : &it->second;
+}
+
+void DialogCache::Set(const std::string& relativePath, Entry entry) {
+    entries[relativePath] = std::move(entry);
+}
@@ -0,0 +1,281 @@
+#include "dialog_pack.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#include "lz4.hpp"
+#include "xxhash64.hpp"
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char PACK_MAGIC[4] = { 'D', 'L', 'P', 'K' };
+constexpr uint32_t PACK_VERSION = 1;
+// Same layout, with entries that may be compressed. Uncompressed packs keep the old version, so
+// they still open in older builds.
+constexpr uint32_t COMPRESSED_PACK_VERSION = 2;
+
+struct PackHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t fingerprint;
+    uint32_t entryCount;
+    uint32_t blobSize;
+};
+
+}
+
+DialogPack::~DialogPack() {
+    Close();
+}
+
+bool DialogPack::Open(const fs::path& path, uint64_t fingerprint) {
+    return Open(path, &fingerprint);
+}
+
+bool DialogPack::Open(const fs::path& path) {
+    return Open(path, nullptr);
+}
+
+bool DialogPack::Open(const fs::path& path, const uint64_t* fingerprint) {
+    Close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(PackHeader)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    data = static_cast<const uint8_t*>(view);
+    size = size_t(fileSize.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(PackHeader)) {
+        close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    if (view == MAP_FAILED) return false;
+
+    data = static_cast<const uint8_t*>(view);
+    size = size_t(info.st_size);
+#endif
+
+    PackHeader header;
+    memcpy(&header, data, sizeof(header));
+    size_t tableSize = size_t(header.entryCount) * sizeof(Entry);
+    if (memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 ||
+        (header.version != PACK_VERSION && header.version != COMPRESSED_PACK_VERSION) ||
+        (fingerprint != nullptr && header.fingerprint != *fingerprint) || size != sizeof(PackHeader) + tableSize + header.blobSize) {
+        Close();
+        return false;
+    }
+
+    entries = reinterpret_cast<const Entry*>(data + sizeof(PackHeader));
+    entryCount = header.entryCount;
+    blob = data + sizeof(PackHeader) + tableSize;
+    compressed = header.version == COMPRESSED_PACK_VERSION;
+
+    // Read copies an entry stored as it is up to its word-rounded length, so that has to be in the
+    // blob too, not just its length; the writer always pads it.
+    for (size_t i = 0; i < entryCount; i++) {
+        uint64_t storedLength = entries[i].compressedLength != 0 ? entries[i].compressedLength : (uint64_t(entries[i].length) + 3) & ~uint64_t(3);
+        if ((!compressed && entries[i].compressedLength != 0) || entries[i].offset + storedLength > header.blobSize) {
+            Close();
+            return false;
+        }
+    }
+
+    hidden = std::make_unique<std::atomic<uint8_t>[]>(entryCount);
+    for (size_t i = 0; i < entryCount; i++) {
+        hidden[i] = 0;
+    }
+    return true;
+}
+
+void DialogPack::Close() {
+    if (data != nullptr) {
+#if defined(_WIN32)
+        UnmapViewOfFile(data);
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        mappingHandle = nullptr;
+        fileHandle = nullptr;
+#else
+        munmap(const_cast<uint8_t*>(data), size);
+#endif
+    }
+
+    data = nullptr;
+    size = 0;
+    entries = nullptr;
+    entryCount = 0;
+    blob = nullptr;
+    compressed = false;
+    hidden.reset();
+}
+
+const DialogPack::Entry* DialogPack::FindEntry(int32_t textId) const {
+    const Entry* end = entries + entryCount;
+    const Entry* it = std::lower_bound(entries, end, textId, [](const Entry& entry, int32_t id) {
+        return entry.textId < id;
+    });
+    if (it == end || it->textId != textId) return nullptr;
+    return it;
+}
+
+uint32_t DialogPack::Read(int32_t textId, uint8_t* dest, uint32_t capacity) const {
+    if (entries == nullptr) return 0;
+    const Entry* entry = FindEntry(textId);
+    if (entry == nullptr || hidden[entry - entries]) return 0;
+
+    // Entries are stored word aligned, and compressed ones padded before compressing, so reading
+    // up to the rounded size is in bounds either way.
+    uint32_t length = std::min((entry->length + 3) & ~3u, capacity);
+    if (dest == nullptr) return length;
+    if (entry->compressedLength == 0) {
+        std::copy_n(blob + entry->offset, length, dest);
+    } else if (LZ4DecompressBlock(blob + entry->offset, entry->compressedLength, dest, length) != length) {
+        return 0;
+    }
+    return length;
+}
+
+const uint8_t* DialogPack::FindStored(int32_t textId, uint32_t& storedLength) const {
+    if (entries == nullptr) return nullptr;
+    const Entry* entry = FindEntry(textId);
+    if (entry == nullptr || hidden[entry - entries]) return nullptr;
+    storedLength = entry->compressedLength != 0 ? entry->compressedLength : entry->length;
+    return blob + entry->offset;
+}
+
+void DialogPack::Hide(int32_t textId) {
+    if (entries == nullptr) return;
+    const Entry* entry = FindEntry(textId);
+    if (entry != nullptr) {
+        hidden[entry - entries] = 1;
+    }
+}
+
+bool DialogPack::Write(const fs::path& path, uint64_t fingerprint,
+    const std::vector<std::pair<int32_t, const std::vector<uint8_t>*>>& binaries, bool compress) {
+    std::vector<std::pair<int32_t, const std::vector<uint8_t>*>> sorted = binaries;
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    // Generic lines ("Huh?", repeated quiz answers) compile to the same bytes under many IDs; point
+    // them all at the first copy. Keyed by hash, then compared, so a collision just costs a copy.
+    std::vector<Entry> table;
+    // Each distinct binary, where it starts in the blob, and its compressed bytes if it's stored
+    // compressed.
+    struct Unique {
+        const std::vector<uint8_t>* binary;
+        uint32_t offset;
+        std::vector<uint8_t> compressed;
+    };
+    std::vector<Unique> unique;
+    std::unordered_multimap<uint64_t, size_t> uniqueByHash;
+    std::vector<uint8_t> padded;
+    table.reserve(sorted.size());
+    uint32_t blobSize = 0;
+    for (const auto& [textId, binary] : sorted) {
+        uint64_t hash = XXH64(binary->data(), binary->size());
+        auto [first, last] = uniqueByHash.equal_range(hash);
+        auto match = std::find_if(first, last, [&](const auto& candidate) {
+            return *unique[candidate.second].binary == *binary;
+        });
+        if (match != last) {
+            const Unique& existing = unique[match->second];
+            table.push_back({ textId, existing.offset, uint32_t(binary->size()), uint32_t(existing.compressed.size()) });
+            continue;
+        }
+
+        uniqueByHash.emplace(hash, unique.size());
+        Unique& added = unique.emplace_back(Unique{ binary, blobSize, {} });
+        // Compiled dialogs are always a multiple of 4 bytes, but keep every entry word aligned regardless.
+        uint32_t paddedSize = (uint32_t(binary->size()) + 3) & ~3u;
+        if (compress && paddedSize > 0) {
+            // Compressed with its padding, so it decompresses to exactly what Read copies otherwise.
+            padded.assign(binary->begin(), binary->end());
+            padded.resize(paddedSize, 0);
+            added.compressed.resize(LZ4CompressBound(paddedSize));
+            added.compressed.resize(LZ4CompressBlock(padded.data(), paddedSize, added.compressed.data()));
+            if (added.compressed.size() >= paddedSize) added.compressed.clear();
+        }
+        table.push_back({ textId, blobSize, uint32_t(binary->size()), uint32_t(added.compressed.size()) });
+        blobSize += added.compressed.empty() ? paddedSize : (uint32_t(added.compressed.size()) + 3) & ~3u;
+    }
+
+    PackHeader header;
+    memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    header.version = compress ? COMPRESSED_PACK_VERSION : PACK_VERSION;
+    header.fingerprint = fingerprint;
+    header.entryCount = uint32_t(table.size());
+    header.blobSize = blobSize;
+
+    fs::path tempPath = path;
+    tempPath += ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(table.data()), std::streamsize(table.size() * sizeof(Entry)));
+        static const char padding[4] = {};
+        for (const Unique& distinct : unique) {
+            const std::vector<uint8_t>& stored = distinct.compressed.empty() ? *distinct.binary : distinct.compressed;
+            file.write(reinterpret_cast<const char*>(stored.data()), std::streamsize(stored.size()));
+            file.write(padding, std::streamsize(((stored.size() + 3) & ~size_t(3)) - stored.size()));
+        }
+        if (!file) return false;
+    }
+
+    std::error_code ec;
+    fs::rename(tempPath, path, ec);
+    if (ec) {
+        fs::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
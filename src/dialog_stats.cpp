@@ -0,0 +1,80 @@
+#include "dialog_stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+uint64_t LatencyHistogram::Snapshot::GetPercentile(double fraction) const {
+    if (count == 0) return 0;
+    uint64_t target = std::max<uint64_t>(1, uint64_t(std::ceil(fraction * double(count))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += buckets[i];
+        // The bucket's limit can be above anything actually recorded.
+        if (seen >= target) return std::min(GetBucketLimit(i), max);
+    }
+    return max;
+}
+
+void LatencyHistogram::AddTo(Snapshot& snapshot) const {
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        uint64_t samples = buckets[i].load(std::memory_order_relaxed);
+        snapshot.buckets[i] += samples;
+        // Summed from the buckets rather than read from count, so percentiles stay consistent
+        // with a concurrent Record.
+        snapshot.count += samples;
+    }
+    snapshot.total += total.load(std::memory_order_relaxed);
+    snapshot.max = std::max(snapshot.max, max.load(std::memory_order_relaxed));
+}
+
+uint64_t LatencyHistogram::GetBucketLimit(size_t bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+    size_t shift = (bucket >> SUB_BUCKET_BITS) - 1;
+    uint64_t first = uint64_t(SUB_BUCKETS | (bucket & (SUB_BUCKETS - 1))) << shift;
+    return first + ((uint64_t(1) << shift) - 1);
+}
+
+PeriodicLog::~PeriodicLog() {
+    Stop();
+}
+
+void PeriodicLog::Start(const fs::path& path, std::chrono::seconds interval, Formatter formatter) {
+    Stop();
+    stopping = false;
+    thread = std::thread([this, path, interval, formatter = std::move(formatter)] { Run(path, interval, formatter); });
+}
+
+void PeriodicLog::Stop() {
+    if (!thread.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        stopping = true;
+    }
+    stopCondition.notify_all();
+    thread.join();
+}
+
+void PeriodicLog::Run(fs::path path, std::chrono::seconds interval, Formatter formatter) {
+    std::unique_lock<std::mutex> lock(stopMutex);
+    while (!stopCondition.wait_for(lock, interval, [this] { return stopping; })) {
+        lock.unlock();
+        std::time_t now = std::time(nullptr);
+        char timestamp[32];
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+
+        // Reopened every time, so the file can be deleted or rotated while the game runs.
+        std::ofstream file(path, std::ios::app);
+        if (file) {
+            file << timestamp << ' ' << formatter() << '\n';
+        } else {
+            printf("[ProxyBK_DialogLoader] Failed to write %s\n", path.string().c_str());
+        }
+        lock.lock();
+    }
+}
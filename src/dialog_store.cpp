@@ -0,0 +1,605 @@
+#include "dialog_store.hpp"
+#include "lz4.hpp"
+#include "xxhash64.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <new>
+#include <set>
+#include <unordered_map>
+
+namespace {
+
+enum : uint32_t { SLOT_EMPTY, SLOT_USED, SLOT_ERASED, SLOT_EVICTED };
+
+constexpr size_t MIN_TABLE_CAPACITY = 16;
+// Blob pool chunks hold a hundred or so entries of typical size and three of the largest.
+constexpr size_t CHUNK_SIZE = 0x4000;
+constexpr size_t BLOCK_ALIGNMENT = 8;
+
+uint32_t HashTextId(int32_t textId) {
+    return uint32_t(textId) * 0x9E3779B1u;
+}
+
+// Smallest capacity that keeps entries at most half of the slots, so a table has room to grow by
+// as much again before it's rebuilt.
+size_t GetTableCapacity(size_t entries) {
+    size_t capacity = MIN_TABLE_CAPACITY;
+    while (entries * 2 > capacity) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+}
+
+DialogStore::~DialogStore() {
+    // Whatever the tables point at is freed by the pool.
+    for (Shard& shard : shards) {
+        delete shard.table.load();
+    }
+}
+
+size_t DialogStore::GetShardIndex(int32_t textId) {
+    // The table probes with the low bits of the same hash, so pick the shard from the high ones.
+    return HashTextId(textId) >> 28;
+}
+
+bool DialogStore::Get(int32_t textId, uint8_t* dest, uint32_t& length) const {
+    EpochReclaimer::Guard guard;
+    const Table* table = Load(textId);
+    const Slot* slot = table != nullptr ? table->Find(textId) : nullptr;
+    const Blob* blob = slot != nullptr ? slot->blob.load(std::memory_order_acquire) : nullptr;
+    if (blob == nullptr) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    table->MarkReferenced(*slot);
+    hits.fetch_add(1, std::memory_order_relaxed);
+    if (dest != nullptr) {
+        blob->CopyTo(dest);
+    }
+    length = blob->length;
+    return true;
+}
+
+const DialogStore::Blob* DialogStore::Intern(const uint8_t* data, size_t size) {
+    // Hashing and interning happen before the shard is locked, so other writers of the shard never
+    // wait on them.
+    return pool.Intern(data, uint32_t(std::min(size, size_t(MAX_ENTRY_SIZE))), compression.load(std::memory_order_relaxed));
+}
+
+void DialogStore::Publish(Shard& shard, std::unique_ptr<Table> table, bool releaseOld) {
+    Table* old = shard.table.exchange(table.release(), std::memory_order_acq_rel);
+    if (old == nullptr) return;
+    if (releaseOld) old->ReleaseAll(pool);
+    EpochReclaimer::Get().Retire(old);
+}
+
+void DialogStore::SetLocked(Shard& shard, int32_t textId, const Blob* blob) {
+    Table* table = shard.table.load(std::memory_order_relaxed);
+    if (table == nullptr) {
+        Publish(shard, std::make_unique<Table>(MIN_TABLE_CAPACITY), false);
+    } else if (!table->Set(textId, blob, pool)) {
+        Publish(shard, table->Rebuild(), false);
+    } else {
+        return;
+    }
+    shard.table.load(std::memory_order_relaxed)->Set(textId, blob, pool);
+}
+
+void DialogStore::Set(int32_t textId, const uint8_t* data, size_t size) {
+    const Blob* blob = Intern(data, size);
+    Shard& shard = shards[GetShardIndex(textId)];
+    {
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        SetLocked(shard, textId, blob);
+        if (size_t budget = shardBudget.load()) {
+            evictions += shard.table.load(std::memory_order_relaxed)->Evict(budget, pool);
+        }
+    }
+    pool.RetireReleased();
+}
+
+void DialogStore::Erase(int32_t textId) {
+    Shard& shard = shards[GetShardIndex(textId)];
+    {
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        if (Table* table = shard.table.load(std::memory_order_relaxed)) {
+            table->Erase(textId, pool);
+        }
+    }
+    pool.RetireReleased();
+}
+
+void DialogStore::Clear() {
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        Publish(shard, nullptr, true);
+    }
+    pool.RetireReleased();
+    EpochReclaimer::Get().Reclaim();
+}
+
+template <typename Entries, typename GetTextId>
+DialogStore::Tables DialogStore::CreateTables(const Entries& entries, GetTextId getTextId) {
+    std::array<size_t, SHARD_COUNT> counts{};
+    for (const auto& entry : entries) {
+        counts[GetShardIndex(getTextId(entry))]++;
+    }
+    Tables tables;
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        if (counts[i] > 0) tables[i] = std::make_unique<Table>(GetTableCapacity(counts[i]));
+    }
+    return tables;
+}
+
+void DialogStore::PublishAll(Tables& tables) {
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        std::lock_guard<std::mutex> lock(shards[i].writeMutex);
+        Publish(shards[i], std::move(tables[i]), true);
+    }
+    pool.RetireReleased();
+    // A whole set of entries was just retired; don't keep it around until the next writes.
+    EpochReclaimer::Get().Reclaim();
+}
+
+void DialogStore::Replace(const std::vector<std::pair<int32_t, const std::vector<uint8_t>*>>& binaries) {
+    Tables tables = CreateTables(binaries, [](const auto& entry) { return entry.first; });
+    for (const auto& [textId, binary] : binaries) {
+        // Sized for every entry, so this always has room.
+        tables[GetShardIndex(textId)]->Set(textId, Intern(binary->data(), binary->size()), pool);
+    }
+    if (size_t budget = shardBudget.load()) {
+        for (std::unique_ptr<Table>& table : tables) {
+            if (table) evictions += table->Evict(budget, pool);
+        }
+    }
+
+    // The old entries are released after the new ones were interned, so blobs both sets share are
+    // never freed and copied again.
+    PublishAll(tables);
+}
+
+void DialogStore::ReplaceEvicted(const std::vector<int32_t>& textIds) {
+    Tables tables = CreateTables(textIds, [](int32_t textId) { return textId; });
+    for (int32_t textId : textIds) {
+        tables[GetShardIndex(textId)]->AddEvicted(textId);
+    }
+    PublishAll(tables);
+}
+
+void DialogStore::SetBudget(size_t bytes) {
+    // Rounded up so a tiny budget still leaves every shard room for one entry.
+    size_t budget = bytes == 0 ? 0 : std::max((bytes + SHARD_COUNT - 1) / SHARD_COUNT, size_t(MAX_ENTRY_SIZE));
+    shardBudget = budget;
+    if (budget == 0) return;
+
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        if (Table* table = shard.table.load(std::memory_order_relaxed)) {
+            evictions += table->Evict(budget, pool);
+        }
+    }
+    pool.RetireReleased();
+}
+
+void DialogStore::SetCompression(bool enabled) {
+    compression = enabled;
+}
+
+bool DialogStore::WasEvicted(int32_t textId) const {
+    EpochReclaimer::Guard guard;
+    const Table* table = Load(textId);
+    const Slot* slot = table != nullptr ? table->Find(textId) : nullptr;
+    return slot != nullptr && slot->state.load(std::memory_order_acquire) == SLOT_EVICTED;
+}
+
+bool DialogStore::Restore(int32_t textId, const std::vector<uint8_t>& binary) {
+    const Blob* blob = Intern(binary.data(), binary.size());
+    Shard& shard = shards[GetShardIndex(textId)];
+    bool restored = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        Table* table = shard.table.load(std::memory_order_relaxed);
+        const Slot* slot = table != nullptr ? table->Find(textId) : nullptr;
+        if (slot == nullptr || slot->state.load(std::memory_order_relaxed) != SLOT_EVICTED) {
+            pool.Release(blob);
+        } else {
+            SetLocked(shard, textId, blob);
+            if (size_t budget = shardBudget.load()) {
+                evictions += shard.table.load(std::memory_order_relaxed)->Evict(budget, pool);
+            }
+            restored = true;
+        }
+    }
+    pool.RetireReleased();
+    return restored;
+}
+
+size_t DialogStore::GetEntryCount() const {
+    size_t count = 0;
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        if (const Table* table = shard.table.load(std::memory_order_relaxed)) {
+            count += table->GetEntryCount();
+        }
+    }
+    return count;
+}
+
+size_t DialogStore::GetDistinctCount() const {
+    return pool.GetCount();
+}
+
+size_t DialogStore::GetResidentBytes() const {
+    size_t bytes = pool.GetBytes();
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        if (const Table* table = shard.table.load(std::memory_order_relaxed)) {
+            bytes += table->GetResidentBytes();
+        }
+    }
+    return bytes;
+}
+
+DialogStore::Stats DialogStore::GetStats() const {
+    return Stats{ hits.load(std::memory_order_relaxed), misses.load(std::memory_order_relaxed), evictions.load() };
+}
+
+void DialogStore::Blob::CopyTo(uint8_t* dest) const {
+    if (compressed) {
+        // Written by Intern, so it always unpacks to exactly length bytes.
+        LZ4DecompressBlock(GetData(), storedLength, dest, length);
+    } else if (length > 0) {
+        memcpy(dest, GetData(), length);
+    }
+}
+
+struct DialogStore::BlobPool::Arena {
+    struct Chunk {
+        std::unique_ptr<uint8_t[]> data;
+        // Blocks in use or waiting in a batch of released blobs.
+        size_t blocks = 0;
+    };
+
+    // Frees its blobs when the EpochReclaimer destroys it.
+    struct ReleasedBlobs {
+        std::shared_ptr<Arena> arena;
+        std::vector<Blob*> blobs;
+
+        ~ReleasedBlobs() {
+            std::lock_guard<std::mutex> lock(arena->mutex);
+            for (Blob* blob : blobs) {
+                arena->Free(blob);
+            }
+        }
+    };
+
+    std::mutex mutex;
+    std::unordered_multimap<uint64_t, Blob*> blobs;
+    // By start address, to find the chunk of a block.
+    std::map<const uint8_t*, Chunk> chunks;
+    // Free ranges of the chunks, never two adjacent ones: by address to merge a freed block with its
+    // neighbours, and by size to cut new blocks from the smallest range they fit in.
+    std::map<uint8_t*, size_t> freeByAddress;
+    std::set<std::pair<size_t, uint8_t*>> freeBySize;
+    std::vector<Blob*> released;
+    // Bytes of the blocks in batches the EpochReclaimer hasn't freed yet.
+    size_t retiredBytes = 0;
+
+    static size_t GetBlockSize(uint32_t storedLength) {
+        return (sizeof(Blob) + storedLength + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1);
+    }
+
+    std::map<const uint8_t*, Chunk>::iterator FindChunk(const uint8_t* block) {
+        return std::prev(chunks.upper_bound(block));
+    }
+
+    void AddFree(uint8_t* start, size_t size) {
+        freeByAddress.emplace(start, size);
+        freeBySize.emplace(size, start);
+    }
+
+    void RemoveFree(std::map<uint8_t*, size_t>::iterator range) {
+        freeBySize.erase({ range->second, range->first });
+        freeByAddress.erase(range);
+    }
+
+    uint8_t* Allocate(size_t size) {
+        auto fit = freeBySize.lower_bound({ size, nullptr });
+        if (fit == freeBySize.end()) {
+            Chunk chunk;
+            chunk.data.reset(new uint8_t[CHUNK_SIZE]);
+            uint8_t* start = chunk.data.get();
+            chunks.emplace(start, std::move(chunk));
+            AddFree(start, CHUNK_SIZE);
+            fit = freeBySize.lower_bound({ size, nullptr });
+        }
+
+        uint8_t* block = fit->second;
+        size_t rest = fit->first - size;
+        RemoveFree(freeByAddress.find(block));
+        if (rest > 0) AddFree(block + size, rest);
+        FindChunk(block)->second.blocks++;
+        return block;
+    }
+
+    void Free(Blob* blob) {
+        uint8_t* start = reinterpret_cast<uint8_t*>(blob);
+        size_t size = GetBlockSize(blob->storedLength);
+        retiredBytes -= size;
+        auto chunk = FindChunk(start);
+        const uint8_t* chunkStart = chunk->first;
+
+        // Merge with the free ranges on either side, within the same chunk.
+        auto next = freeByAddress.lower_bound(start);
+        if (next != freeByAddress.end() && next->first == start + size && start + size < chunkStart + CHUNK_SIZE) {
+            size += next->second;
+            RemoveFree(next);
+        }
+        auto previous = freeByAddress.lower_bound(start);
+        if (previous != freeByAddress.begin() && start != chunkStart) {
+            --previous;
+            if (previous->first + previous->second == start) {
+                start = previous->first;
+                size += previous->second;
+                RemoveFree(previous);
+            }
+        }
+
+        // With nothing left in it, the chunk is one free range by now; give it back.
+        if (--chunk->second.blocks == 0) {
+            chunks.erase(chunk);
+        } else {
+            AddFree(start, size);
+        }
+    }
+};
+
+DialogStore::BlobPool::BlobPool() : arena(std::make_shared<Arena>()) {}
+
+const DialogStore::Blob* DialogStore::BlobPool::Intern(const uint8_t* data, uint32_t size, bool compress) {
+    uint32_t paddedSize = (size + 3) & ~3u;
+    // Compiled entries are whole words already, so the padding is almost never there; an entry
+    // that only matches another once padded is just not shared.
+    uint64_t hash = XXH64(data, size);
+
+    // Compression is deterministic, so a compressed entry matches another one if their compressed
+    // bytes do. One compressed and one stored as is are just not shared.
+    thread_local std::vector<uint8_t> padded;
+    thread_local std::vector<uint8_t> packed;
+    const uint8_t* stored = data;
+    uint32_t storedSize = paddedSize;
+    bool compressed = false;
+    if (compress && paddedSize > 0) {
+        padded.assign(data, data + size);
+        padded.resize(paddedSize, 0);
+        packed.resize(LZ4CompressBound(paddedSize));
+        size_t packedSize = LZ4CompressBlock(padded.data(), paddedSize, packed.data());
+        if (packedSize < paddedSize) {
+            stored = packed.data();
+            storedSize = uint32_t(packedSize);
+            compressed = true;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(arena->mutex);
+    auto range = arena->blobs.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        Blob* blob = it->second;
+        if (blob->length != paddedSize || blob->compressed != compressed) continue;
+        bool same = compressed ? blob->storedLength == storedSize && memcmp(blob->GetData(), stored, storedSize) == 0 :
+            (size == 0 || memcmp(blob->GetData(), data, size) == 0) &&
+            std::all_of(blob->GetData() + size, blob->GetData() + paddedSize, [](uint8_t byte) { return byte == 0; });
+        if (same) {
+            blob->references++;
+            return blob;
+        }
+    }
+
+    Blob* blob = new (arena->Allocate(Arena::GetBlockSize(storedSize))) Blob{ hash, paddedSize, storedSize, 1, compressed };
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(blob + 1);
+    if (compressed) {
+        memcpy(bytes, stored, storedSize);
+    } else {
+        if (size > 0) memcpy(bytes, data, size);
+        memset(bytes + size, 0, paddedSize - size);
+    }
+    arena->blobs.emplace(hash, blob);
+    return blob;
+}
+
+void DialogStore::BlobPool::Release(const Blob* blob) {
+    std::lock_guard<std::mutex> lock(arena->mutex);
+    Blob* owned = const_cast<Blob*>(blob);
+    if (--owned->references > 0) return;
+
+    auto range = arena->blobs.equal_range(blob->hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == owned) {
+            arena->blobs.erase(it);
+            break;
+        }
+    }
+    // Lookups may still be copying out of it.
+    arena->released.push_back(owned);
+}
+
+void DialogStore::BlobPool::RetireReleased() {
+    std::vector<Blob*> blobs;
+    bool reclaim;
+    {
+        std::lock_guard<std::mutex> lock(arena->mutex);
+        if (arena->released.empty()) return;
+        blobs.swap(arena->released);
+        for (const Blob* blob : blobs) {
+            arena->retiredBytes += Arena::GetBlockSize(blob->storedLength);
+        }
+        // Under churn, like eviction at a small budget, the space waiting in batches would otherwise
+        // grow well past what the store holds.
+        reclaim = arena->retiredBytes >= CHUNK_SIZE;
+    }
+    // Outside the lock, as retiring may free an earlier batch.
+    EpochReclaimer::Get().Retire(new Arena::ReleasedBlobs{ arena, std::move(blobs) });
+    if (reclaim) EpochReclaimer::Get().Reclaim();
+}
+
+size_t DialogStore::BlobPool::GetCount() const {
+    std::lock_guard<std::mutex> lock(arena->mutex);
+    return arena->blobs.size();
+}
+
+size_t DialogStore::BlobPool::GetBytes() const {
+    std::lock_guard<std::mutex> lock(arena->mutex);
+    return arena->chunks.size() * CHUNK_SIZE;
+}
+
+DialogStore::Table::Table(size_t tableCapacity)
+    : capacity(tableCapacity),
+      slots(std::make_unique<Slot[]>(tableCapacity)),
+      referenced(std::make_unique<std::atomic<uint8_t>[]>(tableCapacity)) {
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].textId.store(0, std::memory_order_relaxed);
+        slots[i].state.store(SLOT_EMPTY, std::memory_order_relaxed);
+        slots[i].blob.store(nullptr, std::memory_order_relaxed);
+        referenced[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+DialogStore::Slot* DialogStore::Table::FindSlot(int32_t textId) const {
+    size_t mask = capacity - 1;
+    for (size_t i = HashTextId(textId) & mask;; i = (i + 1) & mask) {
+        Slot& slot = slots[i];
+        // Acquire, so the textId written before the slot was published is visible.
+        if (slot.state.load(std::memory_order_acquire) == SLOT_EMPTY) return nullptr;
+        if (slot.textId.load(std::memory_order_relaxed) == textId) return &slot;
+    }
+}
+
+const DialogStore::Slot* DialogStore::Table::Find(int32_t textId) const {
+    return FindSlot(textId);
+}
+
+bool DialogStore::Table::Set(int32_t textId, const Blob* blob, BlobPool& pool) {
+    Slot* slot = FindSlot(textId);
+    if (slot == nullptr) {
+        // Keep the load factor (erased slots included) under 3/4 so probes stay short and always end.
+        if ((occupied + 1) * 4 > capacity * 3) return false;
+
+        size_t mask = capacity - 1;
+        size_t i = HashTextId(textId) & mask;
+        while (slots[i].state.load(std::memory_order_relaxed) != SLOT_EMPTY) {
+            i = (i + 1) & mask;
+        }
+        slot = &slots[i];
+        slot->textId.store(textId, std::memory_order_relaxed);
+        slot->blob.store(blob, std::memory_order_relaxed);
+        occupied++;
+    } else {
+        const Blob* old = slot->blob.exchange(blob, std::memory_order_acq_rel);
+        if (old != nullptr) {
+            liveBytes -= old->storedLength;
+            live--;
+            pool.Release(old);
+        } else if (slot->state.load(std::memory_order_relaxed) == SLOT_EVICTED) {
+            evicted--;
+        }
+    }
+
+    // Fresh entries survive the next pass of the clock hand.
+    referenced[slot - slots.get()].store(1, std::memory_order_relaxed);
+    slot->state.store(SLOT_USED, std::memory_order_release);
+    live++;
+    liveBytes += blob->storedLength;
+    return true;
+}
+
+bool DialogStore::Table::AddEvicted(int32_t textId) {
+    if (FindSlot(textId) != nullptr || (occupied + 1) * 4 > capacity * 3) return false;
+
+    size_t mask = capacity - 1;
+    size_t i = HashTextId(textId) & mask;
+    while (slots[i].state.load(std::memory_order_relaxed) != SLOT_EMPTY) {
+        i = (i + 1) & mask;
+    }
+    slots[i].textId.store(textId, std::memory_order_relaxed);
+    slots[i].state.store(SLOT_EVICTED, std::memory_order_relaxed);
+    occupied++;
+    evicted++;
+    return true;
+}
+
+void DialogStore::Table::Drop(Slot& slot, uint32_t state, BlobPool& pool) {
+    const Blob* blob = slot.blob.exchange(nullptr, std::memory_order_acq_rel);
+    slot.state.store(state, std::memory_order_release);
+    liveBytes -= blob->storedLength;
+    live--;
+    pool.Release(blob);
+}
+
+void DialogStore::Table::Erase(int32_t textId, BlobPool& pool) {
+    if (live == 0 && evicted == 0) return;
+    Slot* slot = FindSlot(textId);
+    if (slot == nullptr) return;
+
+    uint32_t state = slot->state.load(std::memory_order_relaxed);
+    if (state == SLOT_USED) {
+        Drop(*slot, SLOT_ERASED, pool);
+    } else if (state == SLOT_EVICTED) {
+        evicted--;
+        slot->state.store(SLOT_ERASED, std::memory_order_release);
+    }
+}
+
+void DialogStore::Table::ReleaseAll(BlobPool& pool) {
+    for (size_t i = 0; i < capacity; i++) {
+        if (const Blob* blob = slots[i].blob.load(std::memory_order_relaxed)) pool.Release(blob);
+    }
+}
+
+size_t DialogStore::Table::Evict(size_t budget, BlobPool& pool) {
+    size_t count = 0;
+    size_t mask = capacity - 1;
+    // Every pass over the table either clears a referenced bit or evicts, so this ends within two
+    // sweeps even if everything was recently used.
+    while (liveBytes > budget && live > 0) {
+        clockHand = (clockHand + 1) & mask;
+        Slot& slot = slots[clockHand];
+        if (slot.state.load(std::memory_order_relaxed) != SLOT_USED) continue;
+        if (referenced[clockHand].exchange(0, std::memory_order_relaxed)) continue;
+
+        Drop(slot, SLOT_EVICTED, pool);
+        evicted++;
+        count++;
+    }
+    return count;
+}
+
+std::unique_ptr<DialogStore::Table> DialogStore::Table::Rebuild() const {
+    auto table = std::make_unique<Table>(GetTableCapacity(live + evicted + 1));
+    size_t mask = table->capacity - 1;
+    for (size_t j = 0; j < capacity; j++) {
+        const Slot& slot = slots[j];
+        uint32_t state = slot.state.load(std::memory_order_relaxed);
+        if (state != SLOT_USED && state != SLOT_EVICTED) continue;
+
+        int32_t textId = slot.textId.load(std::memory_order_relaxed);
+        size_t i = HashTextId(textId) & mask;
+        while (table->slots[i].state.load(std::memory_order_relaxed) != SLOT_EMPTY) {
+            i = (i + 1) & mask;
+        }
+        table->slots[i].textId.store(textId, std::memory_order_relaxed);
+        table->slots[i].blob.store(slot.blob.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        table->slots[i].state.store(state, std::memory_order_relaxed);
+        table->referenced[i].store(referenced[j].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    table->live = live;
+    table->evicted = evicted;
+    table->occupied = live + evicted;
+    table->liveBytes = liveBytes;
+    // Published with a release store, which makes all of the above visible to lookups.
+    return table;
+}
@@ -0,0 +1,249 @@
+#include "dialog_watcher.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <set>
+
+#if defined(__linux__)
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// How long to keep collecting events after the first one, so an editor's save (truncate, write,
+// rename...) turns into a single recompile.
+constexpr auto SETTLE_TIME = std::chrono::milliseconds(50);
+constexpr auto POLL_INTERVAL = std::chrono::milliseconds(500);
+
+std::string GetKey(const fs::path& filePath) {
+    return filePath.generic_string();
+}
+
+}
+
+DialogWatcher::~DialogWatcher() {
+    Stop();
+}
+
+bool DialogWatcher::Start(const std::vector<fs::path>& watchRoots, Callback changeCallback) {
+    Stop();
+
+    roots.clear();
+    std::error_code ec;
+    for (const fs::path& watchRoot : watchRoots) {
+        if (fs::is_directory(watchRoot, ec)) roots.push_back(watchRoot);
+    }
+    if (roots.empty()) return false;
+
+    callback = std::move(changeCallback);
+    files.clear();
+    std::vector<fs::path> ignored;
+    for (const fs::path& root : roots) {
+        ScanTree(root, ignored);
+    }
+
+#if defined(__linux__)
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd >= 0 && pipe(stopPipe) == 0) {
+        for (const fs::path& root : roots) {
+            AddWatches(root);
+        }
+    } else {
+        printf("[ProxyBK_DialogLoader] inotify unavailable, polling %s for changes instead\n", roots[0].string().c_str());
+        if (inotifyFd >= 0) close(inotifyFd);
+        inotifyFd = -1;
+    }
+#endif
+
+    stopping = false;
+    running = true;
+    thread = std::thread([this] { Run(); });
+    return true;
+}
+
+void DialogWatcher::Stop() {
+    if (!thread.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        stopping = true;
+    }
+    stopCondition.notify_all();
+#if defined(__linux__)
+    if (stopPipe[1] >= 0) {
+        char byte = 0;
+        (void)!write(stopPipe[1], &byte, 1);
+    }
+#endif
+    thread.join();
+    running = false;
+
+#if defined(__linux__)
+    if (inotifyFd >= 0) close(inotifyFd);
+    if (stopPipe[0] >= 0) close(stopPipe[0]);
+    if (stopPipe[1] >= 0) close(stopPipe[1]);
+    inotifyFd = -1;
+    stopPipe[0] = stopPipe[1] = -1;
+    watches.clear();
+#endif
+}
+
+void DialogWatcher::Run() {
+#if defined(__linux__)
+    if (inotifyFd >= 0) {
+        RunInotify();
+        return;
+    }
+#endif
+    RunPolling();
+}
+
+void DialogWatcher::RunPolling() {
+    std::unique_lock<std::mutex> lock(stopMutex);
+    while (!stopCondition.wait_for(lock, POLL_INTERVAL, [this] { return stopping; })) {
+        lock.unlock();
+        std::vector<fs::path> changed;
+        for (const fs::path& root : roots) {
+            ScanTree(root, changed);
+        }
+        Report(changed);
+        lock.lock();
+    }
+}
+
+#if defined(__linux__)
+
+void DialogWatcher::AddWatches(const fs::path& dir) {
+    constexpr uint32_t mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_ONLYDIR;
+    int wd = inotify_add_watch(inotifyFd, dir.c_str(), mask);
+    if (wd >= 0) watches[wd] = dir;
+
+    std::error_code ec;
+    for (const auto& entry : fs::recursive_directory_iterator(dir, ec)) {
+        if (!entry.is_directory(ec)) continue;
+        wd = inotify_add_watch(inotifyFd, entry.path().c_str(), mask);
+        if (wd >= 0) watches[wd] = entry.path();
+    }
+}
+
+void DialogWatcher::RunInotify() {
+    alignas(inotify_event) char buffer[16 * 1024];
+    std::set<fs::path> dirtyFiles;
+    std::set<fs::path> dirtyTrees;
+
+    while (true) {
+        pollfd fds[2] = { { inotifyFd, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+        // Block until something happens, then keep draining until the folder has settled.
+        int timeout = (dirtyFiles.empty() && dirtyTrees.empty()) ? -1 : int(SETTLE_TIME.count());
+        int ready = poll(fds, 2, timeout);
+        if (fds[1].revents != 0) return;
+
+        if (ready <= 0) {
+            std::vector<fs::path> changed;
+            for (const fs::path& dir : dirtyTrees) {
+                ScanTree(dir, changed);
+            }
+            for (const fs::path& filePath : dirtyFiles) {
+                CheckFile(filePath, changed);
+            }
+            dirtyTrees.clear();
+            dirtyFiles.clear();
+            Report(changed);
+            continue;
+        }
+
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        for (ssize_t offset = 0; offset < length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were dropped, only a full rescan can tell what happened.
+                dirtyTrees.insert(roots.begin(), roots.end());
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                watches.erase(event->wd);
+                continue;
+            }
+
+            auto it = watches.find(event->wd);
+            if (it == watches.end() || event->len == 0) continue;
+            fs::path eventPath = it->second / event->name;
+
+            if (event->mask & IN_ISDIR) {
+                // A whole folder appeared or went away: watch it and diff everything under it.
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    AddWatches(eventPath);
+                }
+                dirtyTrees.insert(eventPath);
+            } else {
+                dirtyFiles.insert(eventPath);
+            }
+        }
+    }
+}
+
+#endif
+
+void DialogWatcher::ScanTree(const fs::path& dir, std::vector<fs::path>& changed) {
+    std::string prefix = GetKey(dir);
+    if (!prefix.empty() && prefix.back() != '/') prefix += '/';
+
+    std::map<std::string, FileState> current;
+    std::error_code ec;
+    if (fs::is_directory(dir, ec)) {
+        for (const auto& entry : fs::recursive_directory_iterator(dir, ec)) {
+            if (!entry.is_regular_file(ec)) continue;
+            current.emplace(GetKey(entry.path()), FileState{ entry.file_size(ec), entry.last_write_time(ec) });
+        }
+    }
+
+    // Files under dir that are in the snapshot but weren't found anymore were removed.
+    for (auto it = files.lower_bound(prefix); it != files.end() && it->first.compare(0, prefix.size(), prefix) == 0;) {
+        if (current.count(it->first) == 0) {
+            changed.emplace_back(it->first);
+            it = files.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto& [key, state] : current) {
+        auto [it, inserted] = files.emplace(key, state);
+        if (inserted || it->second.size != state.size || it->second.writeTime != state.writeTime) {
+            it->second = state;
+            changed.emplace_back(key);
+        }
+    }
+}
+
+void DialogWatcher::CheckFile(const fs::path& filePath, std::vector<fs::path>& changed) {
+    std::string key = GetKey(filePath);
+    std::error_code ec;
+    auto it = files.find(key);
+
+    if (!fs::is_regular_file(filePath, ec)) {
+        if (it != files.end()) {
+            files.erase(it);
+            changed.push_back(filePath);
+        }
+        return;
+    }
+
+    FileState state{ fs::file_size(filePath, ec), fs::last_write_time(filePath, ec) };
+    if (it == files.end() || it->second.size != state.size || it->second.writeTime != state.writeTime) {
+        files[key] = state;
+        changed.push_back(filePath);
+    }
+}
+
+void DialogWatcher::Report(std::vector<fs::path>& changed) {
+    if (changed.empty()) return;
+    callback(changed);
+    changed.clear();
+}
@@ -0,0 +1,113 @@
+#include "epoch_reclaimer.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+// Retire tries to reclaim once this many objects are waiting.
+constexpr size_t RECLAIM_THRESHOLD = 64;
+
+// The calling thread's slot and Guard nesting depth.
+struct ThreadReader {
+    std::atomic<uint64_t>* epoch = nullptr;
+    std::atomic<bool>* claimed = nullptr;
+    size_t depth = 0;
+
+    ~ThreadReader() {
+        if (claimed != nullptr) claimed->store(false, std::memory_order_release);
+    }
+};
+
+thread_local ThreadReader threadReader;
+
+}
+
+EpochReclaimer& EpochReclaimer::Get() {
+    // Intentionally leaked, like the thread pool: threads that exit after static destructors ran
+    // still hand their slot back to it.
+    static EpochReclaimer* reclaimer = new EpochReclaimer();
+    return *reclaimer;
+}
+
+void EpochReclaimer::Enter() {
+    ThreadReader& reader = threadReader;
+    if (reader.depth++ > 0) return;
+    if (reader.epoch == nullptr) {
+        ReaderSlot& slot = ClaimSlot();
+        reader.epoch = &slot.epoch;
+        reader.claimed = &slot.claimed;
+    }
+
+    reader.epoch->store(globalEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // Pairs with the fence in TryAdvance: either the writer sees this reader as active, or this
+    // reader sees everything the writer unlinked before advancing.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void EpochReclaimer::Exit() {
+    ThreadReader& reader = threadReader;
+    if (--reader.depth > 0) return;
+    reader.epoch->store(0, std::memory_order_release);
+}
+
+EpochReclaimer::ReaderSlot& EpochReclaimer::ClaimSlot() {
+    for (;;) {
+        for (ReaderSlot& slot : slots) {
+            bool expected = false;
+            if (!slot.claimed.load(std::memory_order_relaxed) &&
+                slot.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return slot;
+            }
+        }
+        // Every slot belongs to a live thread; wait for one to exit.
+        std::this_thread::yield();
+    }
+}
+
+void EpochReclaimer::TryAdvance() {
+    uint64_t epoch = globalEpoch.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (const ReaderSlot& slot : slots) {
+        uint64_t readerEpoch = slot.epoch.load(std::memory_order_acquire);
+        if (readerEpoch != 0 && readerEpoch != epoch) return;
+    }
+    globalEpoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+}
+
+void EpochReclaimer::Retire(void* object, void (*destroy)(void*)) {
+    {
+        std::lock_guard<std::mutex> lock(retiredMutex);
+        retired.push_back(Retired{ globalEpoch.load(std::memory_order_seq_cst), object, destroy });
+        if (retired.size() < RECLAIM_THRESHOLD) return;
+    }
+    Reclaim();
+}
+
+void EpochReclaimer::Reclaim() {
+    // A reader that entered before an object was retired can still hold it until the epoch has
+    // moved twice past the one it was retired in. Trying twice lets an idle process free
+    // everything in one call.
+    TryAdvance();
+    TryAdvance();
+    uint64_t epoch = globalEpoch.load(std::memory_order_acquire);
+
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> lock(retiredMutex);
+        auto waiting = std::partition(retired.begin(), retired.end(), [epoch](const Retired& item) {
+            return item.epoch + 2 > epoch;
+        });
+        ready.assign(waiting, retired.end());
+        retired.erase(waiting, retired.end());
+    }
+    // Outside the lock, destroying something may retire more.
+    for (const Retired& item : ready) {
+        item.destroy(item.object);
+    }
+}
+
+size_t EpochReclaimer::GetPendingCount() const {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    return retired.size();
+}
@@ -0,0 +1,163 @@
+#include "latin1.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <immintrin.h>
+    #define LATIN1_SSE2
+    #if defined(__GNUC__) || defined(__clang__)
+        #define LATIN1_AVX2
+    #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define LATIN1_NEON
+#endif
+
+namespace {
+
+bool IsContinuation(uint8_t byte) {
+    return (byte & 0xC0) == 0x80;
+}
+
+// Decodes the sequence starting with the non-ASCII byte input[i], writes its replacement and returns
+// the index of the next byte to read.
+size_t ConvertSequence(const uint8_t* input, size_t length, size_t i, uint8_t*& out) {
+    uint8_t byte = input[i];
+
+    // UTF-8 2-byte sequence for Latin-1 supplement (0xC2-0xC3)
+    if ((byte == 0xC2 || byte == 0xC3) && i + 1 < length) {
+        uint8_t next_byte = input[i + 1];
+        // Validate that it's a valid UTF-8 continuation byte (0x80-0xBF)
+        if (IsContinuation(next_byte)) {
+            // Code points 0x80-0xFF map directly to ISO-8859-1
+            *out++ = uint8_t(((byte & 0x1F) << 6) | (next_byte & 0x3F));
+            return i + 2;
+        }
+        // Invalid UTF-8 sequence
+        *out++ = '?';
+        return i + 1;
+    }
+
+    // Everything else has no Latin-1 equivalent: one '?' for the lead byte plus the continuation
+    // bytes a sequence of its length can have, as long as they are actually there.
+    size_t continuations = 0;
+    if ((byte & 0xE0) == 0xC0) {
+        continuations = 1;
+    } else if ((byte & 0xF0) == 0xE0) {
+        continuations = 2;
+    } else if ((byte & 0xF8) == 0xF0) {
+        continuations = 3;
+    }
+
+    *out++ = '?';
+    i++;
+    while (continuations-- > 0 && i < length && IsContinuation(input[i])) {
+        i++;
+    }
+    return i;
+}
+
+size_t ConvertScalar(const uint8_t* input, size_t length, size_t i, uint8_t*& out) {
+    while (i < length) {
+        if (input[i] < 0x80) {
+            *out++ = input[i++];
+        } else {
+            i = ConvertSequence(input, length, i, out);
+        }
+    }
+    return i;
+}
+
+#if defined(LATIN1_SSE2)
+
+int CountTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+#endif
+
+#if defined(LATIN1_AVX2)
+
+__attribute__((target("avx2")))
+size_t ConvertAVX2(const uint8_t* input, size_t length, uint8_t* output) {
+    uint8_t* out = output;
+    size_t i = 0;
+    while (i + 32 <= length) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+        // Stored before checking: the ASCII prefix is right either way and the rest gets overwritten.
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), block);
+        uint32_t mask = uint32_t(_mm256_movemask_epi8(block));
+        if (mask == 0) {
+            i += 32;
+            out += 32;
+            continue;
+        }
+        int ascii = CountTrailingZeros(mask);
+        i = ConvertSequence(input, length, i + ascii, out += ascii);
+    }
+    ConvertScalar(input, length, i, out);
+    return size_t(out - output);
+}
+
+bool HasAVX2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#endif
+
+}
+
+size_t ConvertUTF8ToLatin1(const uint8_t* input, size_t length, uint8_t* output) {
+#if defined(LATIN1_AVX2)
+    if (length >= 64 && HasAVX2()) {
+        return ConvertAVX2(input, length, output);
+    }
+#endif
+
+    uint8_t* out = output;
+    size_t i = 0;
+
+#if defined(LATIN1_SSE2)
+    while (i + 16 <= length) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), block);
+        uint32_t mask = uint32_t(_mm_movemask_epi8(block));
+        if (mask == 0) {
+            i += 16;
+            out += 16;
+            continue;
+        }
+        int ascii = CountTrailingZeros(mask);
+        i = ConvertSequence(input, length, i + ascii, out += ascii);
+    }
+#elif defined(LATIN1_NEON)
+    while (i + 16 <= length) {
+        uint8x16_t block = vld1q_u8(input + i);
+        vst1q_u8(out, block);
+        if (vmaxvq_u8(block) < 0x80) {
+            i += 16;
+            out += 16;
+            continue;
+        }
+        // NEON has no movemask; narrow each byte's high bit to a nibble and count the zero ones.
+        uint8x16_t high = vcltq_u8(block, vdupq_n_u8(0x80));
+        uint64_t nibbles = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(high), 4)), 0);
+        int ascii = __builtin_ctzll(~nibbles) / 4;
+        i = ConvertSequence(input, length, i + ascii, out += ascii);
+    }
+#endif
+
+    ConvertScalar(input, length, i, out);
+    return size_t(out - output);
+}
+
+size_t ConvertUTF8ToLatin1Scalar(const uint8_t* input, size_t length, uint8_t* output) {
+    uint8_t* out = output;
+    ConvertScalar(input, length, 0, out);
+    return size_t(out - output);
+}
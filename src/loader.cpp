@@ -3,235 +3,1557 @@
 #include <vector>
 #include <string>
 #include <cstdint>
-#include <sstream>
 #include <stdexcept>
+#include <unordered_map>
+#include <map>
+#include <array>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
+#include <functional>
+#include <string_view>
+#include <charconv>
+#include <cctype>
+#include <climits>
+#include <cstring>
 
 #include "helpers.hpp"
 #include "mod_recomp.h"
+#include "thread_pool.hpp"
+#include "dialog_pack.hpp"
+#include "dialog_store.hpp"
+#include "dialog_watcher.hpp"
+#include "dialog_cache.hpp"
+#include "epoch_reclaimer.hpp"
+#include "dialog_stats.hpp"
+#include "xxhash64.hpp"
+#include "latin1.hpp"
+#include "byte_swap.hpp"
 
 namespace fs = std::filesystem;
 
-fs::path MOD_FOLDER_PATH;
+// The state below that has a destructor is intentionally leaked, like the thread pool: its tasks
+// (language switches, background loads, prefetches, watcher restarts) may still be running when
+// static destructors run at exit or when the library is unloaded.
+fs::path& MOD_FOLDER_PATH = *new fs::path();
 
-std::unordered_map<int32_t, std::array<uint8_t, 0x1000>> dialogMap;
-std::unordered_map<int32_t, std::array<uint8_t, 0x1000>> quizQMap;
-std::unordered_map<int32_t, std::array<uint8_t, 0x1000>> gruntyQMap;
+// Everything that differs between the kinds of text the game loads by ID. Dialogs, quiz questions and
+// Grunty's questions are all lists of (cmd, string) entries behind a small header, so the rest of the
+// pipeline (index, cache, pack, store, async loading, watcher) is shared and driven by one of these.
+struct AssetFormat {
+    // Folder under the language's root, also the name of its .pack and .cache files.
+    const char* folder;
+    const char* extension;
+    // Expected value of the type: line, and what the files are called in log messages.
+    const char* type;
+    const char* description;
+    std::vector<uint8_t> header;
+    std::array<const char*, 2> sections;
+    // Dialogs count each section separately; questions have a single count for all of them.
+    bool sharedCount;
+};
+
+// The layouts the decomp's asset tool converts these files to and from.
+const AssetFormat& DIALOG_FORMAT = *new AssetFormat{ "dialog", ".dialog", "Dialog", "dialogs", { 0x01, 0x03, 0x00 }, { "bottom:", "top:" }, false };
+const AssetFormat& QUIZ_Q_FORMAT = *new AssetFormat{ "quiz_q", ".quiz_q", "QuizQuestion", "quiz questions", { 0x01, 0x01, 0x02, 0x05, 0x00 }, { "question:", "options:" }, true };
+const AssetFormat& GRUNTY_Q_FORMAT = *new AssetFormat{ "grunty_q", ".grunty_q", "GruntyQuestion", "Grunty questions", { 0x01, 0x03, 0x00, 0x05, 0x00 }, { "question:", "options:" }, true };
+
+// When set, RefreshAll only builds the index and leaves compiling to the thread pool.
+bool asyncLoading = false;
+// When set, RefreshAll only builds the index and each file is compiled the first time its ID is
+// looked up. Takes precedence over asyncLoading.
+bool lazyLoading = false;
+// When set, the stores keep entries LZ4-compressed and packs and caches are written compressed.
+// Atomic, as background loads and language switches read it when they write their pack.
+std::atomic<bool> compressedStorage{false};
+
+// A folder tree registered with DialogLoader_AddOverlay, with the same layout as DialogLoader/ (or a
+// language), whose files are layered over or under the current language's.
+struct OverlayRoot {
+    // Relative to the mods folder.
+    fs::path root;
+    int32_t priority;
+};
+
+// Sorted by registration order. Guarded by overlayMutex rather than refreshMutex, so a language
+// switch can read it without waiting on a refresh.
+std::vector<OverlayRoot>& overlayRoots = *new std::vector<OverlayRoot>();
+std::mutex& overlayMutex = *new std::mutex();
+// Set when overlayRoots changes, so the next RefreshAll restarts the watchers that are running.
+std::atomic<bool> overlaysChanged{false};
+
+// One asset folder an index is built from.
+struct AssetLayer {
+    fs::path folderPath;
+    // When several layers have a file for the same text ID, the highest priority wins. The
+    // language's own folder is 0 and wins ties, then overlays win in the order they were added.
+    int32_t priority;
+};
+
+struct IndexedFile {
+    fs::path path;
+    // Relative to its layer's asset folder, with forward slashes.
+    std::string relativePath;
+    uint64_t size = 0;
+    int64_t writeTime = 0;
+    // Position of its layer in AssetIndex::layers; 0 is the language's own folder.
+    uint32_t layer = 0;
+};
+
+// textId -> file, built in a single pass over every layer of an asset folder and kept for the
+// session, so refreshing one ID is a hash lookup instead of a recursive directory walk however
+// many layers there are.
+struct AssetIndex {
+    std::vector<AssetLayer> layers;
+    // The file each ID resolved to.
+    std::unordered_map<int32_t, IndexedFile> files;
+    // Files that lost to the one in files, best first, so the watcher can fall back to the next
+    // one when the winner is removed. Only IDs with conflicts are in it.
+    std::unordered_map<int32_t, std::vector<IndexedFile>> shadowed;
+    // Every directory seen during the scan with its mtime; adding, removing or renaming a file
+    // bumps the mtime of its parent, so this is enough to tell when the index is out of date.
+    std::vector<std::pair<fs::path, fs::file_time_type>> directories;
+    // Combined hash of every file's name, size and mtime, used to tell whether the .pack is current.
+    uint64_t fingerprint = 0;
+};
+
+struct AsyncLoad;
+
+// The packs lookups fall back to when the store doesn't have an ID, swapped as a unit.
+struct AssetPacks {
+    // Written by the loader after compiling the folder, only used while it matches the files.
+    DialogPack compiled;
+    // Compiled ahead of time with the dialog compiler and shipped instead of (or under) the files.
+    // The folder's files take precedence over it.
+    DialogPack prebuilt;
 
-struct BKString {
-    uint8_t cmd;
-    std::vector<uint8_t> string;
+    uint32_t Read(int32_t textId, uint8_t* dest, uint32_t capacity) const {
+        uint32_t length = compiled.Read(textId, dest, capacity);
+        return length > 0 ? length : prebuilt.Read(textId, dest, capacity);
+    }
+
+    const uint8_t* FindStored(int32_t textId, uint32_t& storedLength) const {
+        const uint8_t* data = compiled.FindStored(textId, storedLength);
+        return data != nullptr ? data : prebuilt.FindStored(textId, storedLength);
+    }
+
+    size_t GetMappedSize() const {
+        return compiled.GetMappedSize() + prebuilt.GetMappedSize();
+    }
+};
+
+// Timings of the per-ID entry points of one asset kind, recorded on every call.
+struct AssetStats {
+    // ReadAsset calls that found a replacement and that didn't.
+    LatencyHistogram hits;
+    LatencyHistogram misses;
+    // Per-ID refreshes that actually went to the file system.
+    LatencyHistogram refreshes;
 };
 
-struct Dialog {
-    std::vector<BKString> bottom;
-    std::vector<BKString> top;
+// The loaded state of one asset kind.
+struct AssetLoader {
+    explicit AssetLoader(const AssetFormat& assetFormat) : format(assetFormat) {}
+
+    const AssetFormat& format;
+    DialogStore store;
+    AssetIndex index;
+    // Writers hold refreshMutex as well; this only lets lookups that have to go back to the source
+    // of an evicted entry read the index without waiting on a whole refresh.
+    std::shared_mutex indexMutex;
+    // Swapped as a whole by RefreshAll and language switches with SetPacks; the old one is retired,
+    // so a pack stays mapped until the last lookup that found it is done copying. Intentionally
+    // leaked at exit, like the watcher.
+    std::atomic<AssetPacks*> packs{new AssetPacks()};
+    std::shared_ptr<AsyncLoad> asyncLoad;
+    std::mutex asyncLoadMutex;
+    // Whether asyncLoad is set, so lookups only take asyncLoadMutex while something is loading.
+    std::atomic<bool> asyncLoading{false};
+    // Intentionally leaked, like the thread pool.
+    DialogWatcher& watcher = *new DialogWatcher();
+    AssetStats stats;
 };
 
-static Dialog LoadDialogFromPath(const std::string& path) {
-    std::ifstream file(path);
+AssetLoader& dialogLoader = *new AssetLoader(DIALOG_FORMAT);
+AssetLoader& quizQLoader = *new AssetLoader(QUIZ_Q_FORMAT);
+AssetLoader& gruntyQLoader = *new AssetLoader(GRUNTY_Q_FORMAT);
+
+AssetLoader* const assetLoaders[] = { &dialogLoader, &quizQLoader, &gruntyQLoader };
+
+// Serializes everything that rebuilds an index or republishes entries: RefreshAll, the per-ID
+// refreshes, the folder watchers and language switches. Lookups never take it.
+std::mutex& refreshMutex = *new std::mutex();
+
+// Subfolder of DialogLoader/languages/ the assets are loaded from, empty for DialogLoader/ itself.
+// Guarded by refreshMutex.
+std::string& currentLanguage = *new std::string();
+// Bumped by every language switch, so one that was overtaken by a newer one doesn't publish.
+std::atomic<uint32_t> languageGeneration{0};
+
+// Serializes starting and stopping the folder watchers. Taken before refreshMutex, never after it:
+// stopping a watcher waits for its callback, which may be waiting on refreshMutex.
+std::mutex& watcherMutex = *new std::mutex();
+
+// Callers must hold an EpochReclaimer::Guard, or refreshMutex, for as long as they use the result.
+static AssetPacks& GetPacks(const AssetLoader& loader) {
+    return *loader.packs.load(std::memory_order_acquire);
+}
+
+// Caller must hold refreshMutex.
+static void SetPacks(AssetLoader& loader, std::unique_ptr<AssetPacks> packs) {
+    EpochReclaimer::Get().Retire(loader.packs.exchange(packs.release(), std::memory_order_acq_rel));
+}
+
+static void ReadDialogFile(const std::string& path, std::string& contents) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
     if (!file) {
         throw std::runtime_error("Cannot open file: " + path);
     }
 
-    Dialog result;
-    std::string line;
-    std::vector<BKString>* current_section = nullptr;
+    contents.resize(size_t(file.tellg()));
+    file.seekg(0);
+    if (!file.read(contents.data(), std::streamsize(contents.size()))) {
+        throw std::runtime_error("Cannot read file: " + path);
+    }
+}
+
+static bool StartsWith(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+// Same rules as std::stoi(text, nullptr, 0), which the format has always been parsed with: optional
+// sign, then 0x for hex, a leading 0 for octal, decimal otherwise, stopping at the first bad digit.
+static int ParseInteger(std::string_view text) {
+    const char* it = text.data();
+    const char* end = it + text.size();
+    while (it != end && (*it == ' ' || (*it >= '\t' && *it <= '\r'))) it++;
+
+    bool negative = false;
+    if (it != end && (*it == '+' || *it == '-')) {
+        negative = *it == '-';
+        it++;
+    }
+
+    int base = 10;
+    if (end - it >= 2 && it[0] == '0' && (it[1] == 'x' || it[1] == 'X')) {
+        if (end - it > 2 && isxdigit((unsigned char)it[2])) {
+            base = 16;
+            it += 2;
+        } else {
+            // "0x" without hex digits after it reads as just the 0.
+            return 0;
+        }
+    } else if (it != end && *it == '0') {
+        base = 8;
+    }
+
+    long long value = 0;
+    auto [ptr, ec] = std::from_chars(it, end, value, base);
+    if (ec == std::errc::invalid_argument) {
+        throw std::invalid_argument("stoi");
+    }
+    if (ec == std::errc::result_out_of_range) {
+        throw std::out_of_range("stoi");
+    }
+    if (negative) value = -value;
+    if (value < INT32_MIN || value > INT32_MAX) {
+        throw std::out_of_range("stoi");
+    }
+    return int(value);
+}
+
+// Something CompileAsset noticed about a line: an error it fails the file for, or a warning about
+// what it accepts but the game won't show as written. Only collected for dialog_compiler; the game
+// just compiles.
+struct AssetDiagnostic {
+    size_t line;
+    bool error;
+    std::string message;
+};
+
+// Longest string the length byte can describe, leaving room for the terminator it counts.
+constexpr size_t MAX_STRING_LENGTH = 254;
+constexpr size_t MAX_ENTRY_COUNT = 255;
+
+// Parses inline format: - { cmd: 0x83, string: "text" } and writes the encoded entry at out: cmd,
+// length including the null terminator, the text converted to ISO-8859-1 (the game's character
+// set) and the null terminator. Never writes more bytes than the line is long. Warnings, and what
+// the game doesn't fail on but can't show either, go to diagnostics when it's set.
+static void WriteEntry(std::string_view line, uint8_t*& out, std::vector<AssetDiagnostic>* diagnostics = nullptr,
+    size_t line_number = 0) {
+    uint8_t cmd = 0;
+
+    // Extract cmd value
+    size_t cmd_pos = line.find("cmd:");
+    if (cmd_pos != std::string_view::npos) {
+        size_t cmd_start = cmd_pos + 4;
+        size_t cmd_end = line.find_first_of(",}", cmd_start);
+        std::string_view cmd_str = line.substr(cmd_start, cmd_end - cmd_start);
+        // Trim spaces
+        size_t first = cmd_str.find_first_not_of(" \t");
+        if (first == std::string_view::npos) {
+            throw std::invalid_argument("cmd is not a number");
+        }
+        cmd_str = cmd_str.substr(first);
+        cmd_str = cmd_str.substr(0, cmd_str.find_last_not_of(" \t") + 1);
+        // Parse hex or decimal
+        int value;
+        try {
+            value = ParseInteger(cmd_str);
+        } catch (const std::exception&) {
+            throw std::invalid_argument("cmd is not a number");
+        }
+        if (diagnostics != nullptr && (value < 0 || value > 0xFF)) {
+            diagnostics->push_back(AssetDiagnostic{ line_number, false,
+                "cmd " + std::to_string(value) + " doesn't fit in a byte and is truncated" });
+        }
+        cmd = static_cast<uint8_t>(value);
+    } else if (diagnostics != nullptr) {
+        diagnostics->push_back(AssetDiagnostic{ line_number, false, "entry has no cmd, 0 is used" });
+    }
+
+    // Extract string value
+    std::string_view text;
+    size_t string_pos = line.find("string:");
+    if (string_pos != std::string_view::npos) {
+        size_t string_start = string_pos + 7;
+        // Find opening quote
+        size_t quote_start = line.find_first_of("\"'", string_start);
+        size_t quote_end = std::string_view::npos;
+        if (quote_start != std::string_view::npos) {
+            char quote_char = line[quote_start];
+            quote_end = line.find(quote_char, quote_start + 1);
+            if (quote_end != std::string_view::npos) {
+                text = line.substr(quote_start + 1, quote_end - quote_start - 1);
+            }
+        }
+        if (diagnostics != nullptr && quote_end == std::string_view::npos) {
+            diagnostics->push_back(AssetDiagnostic{ line_number, false, "string has no closing quote and is left empty" });
+        }
+    }
+
+    size_t length = ConvertUTF8ToLatin1(reinterpret_cast<const uint8_t*>(text.data()), text.size(), out + 2);
+    if (diagnostics != nullptr) {
+        if (length > MAX_STRING_LENGTH) {
+            diagnostics->push_back(AssetDiagnostic{ line_number, true, "string is " + std::to_string(length) +
+                " bytes in the game's character set, the limit is " + std::to_string(MAX_STRING_LENGTH) });
+        }
+        size_t replaced = size_t(std::count(out + 2, out + 2 + length, '?')) - size_t(std::count(text.begin(), text.end(), '?'));
+        if (replaced > 0) {
+            diagnostics->push_back(AssetDiagnostic{ line_number, false,
+                std::to_string(replaced) + " character(s) outside ISO-8859-1 will show as '?'" });
+        }
+    }
+    out[0] = cmd;
+    out[1] = static_cast<uint8_t>(length + 1); // includes the null terminator
+    out[length + 2] = 0x00;
+    out += length + 3;
+}
+
+// Bump whenever CompileAsset gives different bytes for the same file, so the .cache and .pack files
+// an older build wrote are recompiled instead of served.
+constexpr uint32_t COMPILER_VERSION = 1;
+
+// Compiles the text of an asset file straight into the binary the game reads, already in guest byte
+// order: the format's header, then the entries of each section behind their count (or all of them
+// behind one count), padded to whole words.
+//
+// Poor man's YAML parsing since I don't want to add a dependency on a YAML library just for this.
+// Lines are tokenized in place and every entry is encoded into its final position. An entry is never
+// longer than its line, so the output is sized once up front and trimmed at the end.
+//
+// Throws on the first error, unless diagnostics is set: then every error and warning is added to it
+// with its line and compiling goes on, and the caller must check it for errors before using out.
+static void CompileAsset(std::string_view contents, const AssetFormat& format, std::vector<uint8_t>& out,
+    std::vector<AssetDiagnostic>* diagnostics = nullptr) {
+    // The first section is written straight to out; the second comes after it in the binary but may
+    // come first in the file, so it's collected separately.
+    thread_local std::vector<uint8_t> second;
+    if (second.size() < contents.size()) {
+        second.resize(contents.size());
+    }
+    size_t header_size = format.header.size();
+    out.resize(header_size + contents.size() + 8);
+    std::array<uint8_t*, 2> section_out = { out.data() + header_size + 1, second.data() };
+    std::array<size_t, 2> counts = { 0, 0 };
+    size_t current_section = SIZE_MAX;
+    // Only kept for diagnostics.
+    std::array<size_t, 2> section_lines = { 0, 0 };
+    bool saw_type = false;
+
+    size_t line_start = 0;
+    size_t line_number = 0;
+    while (line_start < contents.size()) {
+        size_t line_end = contents.find('\n', line_start);
+        if (line_end == std::string_view::npos) line_end = contents.size();
+        std::string_view line = contents.substr(line_start, line_end - line_start);
+        line_start = line_end + 1;
+        line_number++;
 
-    // Poor man's YAML parsing since I don't want to add a dependency on a YAML library just for this
-    while (std::getline(file, line)) {
         // Trim leading spaces
         size_t start = line.find_first_not_of(" \t\r");
-        if (start == std::string::npos) continue;
+        if (start == std::string_view::npos) continue;
         line = line.substr(start);
 
-        if (line.find("type:") == 0) {
-            if (line.find("Dialog") == std::string::npos) {
-                throw std::runtime_error("Expected Dialog type");
+        try {
+            if (StartsWith(line, "type:")) {
+                saw_type = true;
+                if (line.find(format.type) == std::string_view::npos) {
+                    throw std::runtime_error(std::string("Expected ") + format.type + " type");
+                }
             }
+            else if (StartsWith(line, format.sections[0])) {
+                current_section = 0;
+                if (section_lines[0] == 0) section_lines[0] = line_number;
+            }
+            else if (StartsWith(line, format.sections[1])) {
+                current_section = 1;
+                if (section_lines[1] == 0) section_lines[1] = line_number;
+            }
+            else if (line.find("- {") != std::string_view::npos && current_section != SIZE_MAX) {
+                WriteEntry(line, section_out[current_section], diagnostics, line_number);
+                counts[current_section]++;
+            }
+            else if (diagnostics != nullptr && line.find("- {") != std::string_view::npos) {
+                diagnostics->push_back(AssetDiagnostic{ line_number, false,
+                    std::string("entry before ") + format.sections[0] + " is ignored" });
+            }
+        } catch (const std::exception& e) {
+            if (diagnostics == nullptr) {
+                throw std::runtime_error("line " + std::to_string(line_number) + ": " + e.what());
+            }
+            diagnostics->push_back(AssetDiagnostic{ line_number, true, e.what() });
+        }
+    }
+
+    if (diagnostics != nullptr) {
+        if (!saw_type) {
+            diagnostics->push_back(AssetDiagnostic{ 1, false, std::string("no type: line, expected ") + format.type });
+        }
+        if (format.sharedCount && counts[0] + counts[1] > MAX_ENTRY_COUNT) {
+            diagnostics->push_back(AssetDiagnostic{ section_lines[0], true, std::to_string(counts[0] + counts[1]) +
+                " entries, the limit is " + std::to_string(MAX_ENTRY_COUNT) });
         }
-        else if (line.find("bottom:") == 0) {
-            current_section = &result.bottom;
-        }
-        else if (line.find("top:") == 0) {
-            current_section = &result.top;
-        }
-        else if (line.find("- {") != std::string::npos && current_section) {
-            // Parse inline format: - { cmd: 0x83, string: "text" }
-            BKString bkstr;
-
-            // Extract cmd value
-            size_t cmd_pos = line.find("cmd:");
-            if (cmd_pos != std::string::npos) {
-                size_t cmd_start = cmd_pos + 4;
-                size_t cmd_end = line.find_first_of(",}", cmd_start);
-                std::string cmd_str = line.substr(cmd_start, cmd_end - cmd_start);
-                // Trim spaces
-                cmd_str = cmd_str.substr(cmd_str.find_first_not_of(" \t"));
-                cmd_str = cmd_str.substr(0, cmd_str.find_last_not_of(" \t") + 1);
-                // Parse hex or decimal
-                bkstr.cmd = static_cast<uint8_t>(std::stoi(cmd_str, nullptr, 0));
+        for (size_t i = 0; i < counts.size() && !format.sharedCount; i++) {
+            if (counts[i] > MAX_ENTRY_COUNT) {
+                diagnostics->push_back(AssetDiagnostic{ section_lines[i], true, std::string(format.sections[i]) + " has " +
+                    std::to_string(counts[i]) + " entries, the limit is " + std::to_string(MAX_ENTRY_COUNT) });
             }
+        }
+    }
 
-            // Extract string value
-            size_t string_pos = line.find("string:");
-            if (string_pos != std::string::npos) {
-                size_t string_start = string_pos + 7;
-                // Find opening quote
-                size_t quote_start = line.find_first_of("\"'", string_start);
-                if (quote_start != std::string::npos) {
-                    char quote_char = line[quote_start];
-                    size_t quote_end = line.find(quote_char, quote_start + 1);
-                    if (quote_end != std::string::npos) {
-                        std::string text = line.substr(quote_start + 1, quote_end - quote_start - 1);
-                        bkstr.string = std::vector<uint8_t>(text.begin(), text.end());
-                    }
-                } else {
-                    // Empty string case
-                    bkstr.string.clear();
-                }
+    uint8_t* header = out.data();
+    memcpy(header, format.header.data(), header_size);
+    uint8_t* end = section_out[0];
+    if (format.sharedCount) {
+        header[header_size] = static_cast<uint8_t>(counts[0] + counts[1]);
+    } else {
+        header[header_size] = static_cast<uint8_t>(counts[0]);
+        *end++ = static_cast<uint8_t>(counts[1]);
+    }
+    size_t second_size = size_t(section_out[1] - second.data());
+    memcpy(end, second.data(), second_size);
+
+    // Pad to 4-byte alignment and swap every word into the guest's byte order.
+    size_t size = size_t(end - header) + second_size;
+    size_t padded_size = (size + 3) & ~size_t(3);
+    memset(header + size, 0, padded_size - size);
+    out.resize(padded_size);
+    SwapWords(out.data(), out.size());
+}
+
+// Each language has the same layout (asset folders, packs and caches) under its own root.
+static fs::path GetLanguageRoot(const std::string& language) {
+    fs::path root = MOD_FOLDER_PATH / "DialogLoader";
+    return language.empty() ? root : root / "languages" / language;
+}
+
+static fs::path GetFolderPath(const fs::path& root, const AssetFormat& format) {
+    return root / format.folder;
+}
+
+static fs::path GetPackPath(const fs::path& root, const AssetFormat& format) {
+    return root / (std::string(format.folder) + ".pack");
+}
+
+// Where the dialog compiler's output goes; never written at runtime.
+static fs::path GetPrebuiltPackPath(const fs::path& root, const AssetFormat& format) {
+    return root / (std::string(format.folder) + ".prebuilt.pack");
+}
+
+static fs::path GetCachePath(const fs::path& root, const AssetFormat& format) {
+    return root / (std::string(format.folder) + ".cache");
+}
+
+// Asset files are named after their text ID in hex, e.g. 0B68.dialog.
+static bool ParseTextId(const fs::path& filePath, int32_t& textId) {
+    std::string fileName = filePath.stem().string();
+    try {
+        size_t parsed = 0;
+        textId = std::stoi(fileName, &parsed, 16);
+        if (parsed == fileName.size()) return true;
+    } catch (const std::exception&) {
+    }
+    printf("[ProxyBK_DialogLoader] Skipping %s: file name is not a hex text ID\n", filePath.string().c_str());
+    return false;
+}
+
+static IndexedFile MakeIndexedFile(const AssetIndex& index, uint32_t layer, const fs::path& filePath, uint64_t size, int64_t writeTime) {
+    return IndexedFile{ filePath, filePath.lexically_relative(index.layers[layer].folderPath).generic_string(), size, writeTime, layer };
+}
+
+// The key of a file in the .cache. Files of overlays are keyed by their full path, as the same
+// relative path can be in several layers.
+static std::string GetCacheKey(const IndexedFile& file) {
+    return file.layer == 0 ? file.relativePath : file.path.generic_string();
+}
+
+// Whether a wins over b for the same text ID. Two files of the same layer (in different
+// subfolders) are ordered by path, so the result doesn't depend on directory iteration order.
+static bool Outranks(const AssetIndex& index, const IndexedFile& a, const IndexedFile& b) {
+    int32_t priorityA = index.layers[a.layer].priority;
+    int32_t priorityB = index.layers[b.layer].priority;
+    if (priorityA != priorityB) return priorityA > priorityB;
+    if (a.layer != b.layer) return a.layer < b.layer;
+    return a.relativePath < b.relativePath;
+}
+
+// Adds file to the shadowed files of textId, keeping them best first.
+static void AddShadowedFile(AssetIndex& index, int32_t textId, IndexedFile file) {
+    std::vector<IndexedFile>& candidates = index.shadowed[textId];
+    auto position = std::find_if(candidates.begin(), candidates.end(), [&](const IndexedFile& candidate) {
+        return Outranks(index, file, candidate);
+    });
+    candidates.insert(position, std::move(file));
+}
+
+// The language's own folder for format under root, then the same folder of every overlay.
+static std::vector<AssetLayer> GetAssetLayers(const fs::path& root, const AssetFormat& format) {
+    std::vector<AssetLayer> layers{ AssetLayer{ GetFolderPath(root, format), 0 } };
+    std::lock_guard<std::mutex> lock(overlayMutex);
+    for (const OverlayRoot& overlay : overlayRoots) {
+        layers.push_back(AssetLayer{ GetFolderPath(MOD_FOLDER_PATH / overlay.root, format), overlay.priority });
+    }
+    return layers;
+}
+
+static AssetIndex BuildAssetIndex(const AssetFormat& format, std::vector<AssetLayer> layers) {
+    AssetIndex index;
+    index.layers = std::move(layers);
+    // Text IDs each layer lost to another one, reported once per pair of layers.
+    std::map<std::pair<uint32_t, uint32_t>, size_t> overridden;
+    for (uint32_t layer = 0; layer < index.layers.size(); layer++) {
+        const fs::path& folderPath = index.layers[layer].folderPath;
+        std::error_code ec;
+        if (!fs::is_directory(folderPath, ec)) continue;
+
+        index.directories.emplace_back(folderPath, fs::last_write_time(folderPath, ec));
+        // Overlay files are told apart from the language's own by their folder, so moving a file
+        // from one layer to another changes the fingerprint.
+        uint64_t layerHash = HashBytes(nullptr, 0);
+        if (layer > 0) {
+            std::string folder = folderPath.generic_string();
+            layerHash = HashBytes(folder.data(), folder.size());
+        }
+
+        for (const auto& entry : fs::recursive_directory_iterator(folderPath, ec)) {
+            if (entry.is_directory(ec)) {
+                index.directories.emplace_back(entry.path(), entry.last_write_time(ec));
+                continue;
+            }
+            if (!entry.is_regular_file(ec)) continue;
+            const fs::path& filePath = entry.path();
+            if (filePath.extension() != format.extension) continue;
+
+            int32_t textId;
+            if (!ParseTextId(filePath, textId)) continue;
+
+            IndexedFile file = MakeIndexedFile(index, layer, filePath, entry.file_size(ec), entry.last_write_time(ec).time_since_epoch().count());
+
+            // Summed rather than chained so the result doesn't depend on directory iteration order.
+            uint64_t fileHash = HashBytes(file.relativePath.data(), file.relativePath.size(), layerHash);
+            fileHash = HashBytes(&file.size, sizeof(file.size), fileHash);
+            fileHash = HashBytes(&file.writeTime, sizeof(file.writeTime), fileHash);
+            index.fingerprint += fileHash;
+
+            auto [it, inserted] = index.files.emplace(textId, file);
+            if (inserted) continue;
+            if (Outranks(index, file, it->second)) std::swap(it->second, file);
+            if (file.layer == it->second.layer) {
+                printf("[ProxyBK_DialogLoader] Duplicate text ID %04X: using %s, ignoring %s\n",
+                    textId, it->second.path.string().c_str(), file.path.string().c_str());
+            } else {
+                overridden[{ it->second.layer, file.layer }]++;
             }
+            AddShadowedFile(index, textId, std::move(file));
+        }
+    }
+
+    // Packs written by another version of the compiler are never current.
+    index.fingerprint += HashBytes(&COMPILER_VERSION, sizeof(COMPILER_VERSION));
+
+    for (const auto& [layers, count] : overridden) {
+        printf("[ProxyBK_DialogLoader] %zu %s in %s (priority %d) override %s (priority %d)\n", count, format.description,
+            index.layers[layers.first].folderPath.string().c_str(), index.layers[layers.first].priority,
+            index.layers[layers.second].folderPath.string().c_str(), index.layers[layers.second].priority);
+    }
+    return index;
+}
+
+// Rescans the current language's folder and the overlays. Caller must hold refreshMutex.
+static void RebuildAssetIndex(AssetLoader& loader) {
+    AssetIndex index = BuildAssetIndex(loader.format, GetAssetLayers(GetLanguageRoot(currentLanguage), loader.format));
+    std::unique_lock<std::shared_mutex> lock(loader.indexMutex);
+    loader.index = std::move(index);
+}
+
+static bool IsAssetIndexStale(const AssetLoader& loader) {
+    if (loader.index.directories.empty()) {
+        std::error_code ec;
+        for (const AssetLayer& layer : loader.index.layers) {
+            if (fs::is_directory(layer.folderPath, ec)) return true;
+        }
+        return loader.index.layers.empty() && fs::is_directory(GetFolderPath(GetLanguageRoot(currentLanguage), loader.format), ec);
+    }
+
+    for (const auto& [dirPath, writeTime] : loader.index.directories) {
+        std::error_code ec;
+        if (fs::last_write_time(dirPath, ec) != writeTime || ec) return true;
+    }
+    return false;
+}
+
+// Time spent in each stage of compiling a file, summed over every thread that worked on it.
+struct LoadTimings {
+    std::atomic<int64_t> readNs{0};
+    // Parsing and encoding, which happen in the same pass.
+    std::atomic<int64_t> parseNs{0};
+    // Files that were parsed, files whose compiled bytes came out of the .cache file instead, and
+    // files that were copies of one compiled earlier in the same load.
+    std::atomic<size_t> parsed{0};
+    std::atomic<size_t> cached{0};
+    std::atomic<size_t> duplicates{0};
+};
+
+// Every file compiled since startup, whatever compiled it: loads, refreshes, restores.
+LoadTimings totalTimings;
+
+std::atomic<uint64_t> refreshAllCount{0};
+std::atomic<int64_t> lastRefreshAllNs{0};
+
+// Intentionally leaked, like the watchers.
+PeriodicLog& statsLog = *new PeriodicLog();
+
+static int64_t ElapsedNs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+static double NsToMs(int64_t ns) {
+    return ns / 1000000.0;
+}
+
+static ThreadPool& GetThreadPool() {
+    // Intentionally leaked: joining threads from a static destructor while the library is being
+    // unloaded can deadlock on Windows, and the OS reclaims the workers at exit anyway.
+    static ThreadPool* pool = new ThreadPool();
+    return *pool;
+}
+
+// Files compiled so far in one load, by the hash and size of their contents, so a file that's a copy
+// of another one (the same line under several IDs, boilerplate) is read but not parsed again. The
+// hash is trusted the same way the cache trusts it. Points at the load's own binaries, which stay
+// put and unchanged once compiled.
+class CompiledContents {
+public:
+    const std::vector<uint8_t>* Find(uint64_t contentHash, size_t size) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = binaries.find(contentHash);
+        return it != binaries.end() && it->second.first == size ? it->second.second : nullptr;
+    }
+
+    void Add(uint64_t contentHash, size_t size, const std::vector<uint8_t>* binary) {
+        std::lock_guard<std::mutex> lock(mutex);
+        binaries.emplace(contentHash, std::make_pair(size, binary));
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, std::pair<size_t, const std::vector<uint8_t>*>> binaries;
+};
+
+// Reads, parses and encodes a single file. Errors are reported here so callers only need to
+// know whether there is something to publish.
+//
+// With a cache, a file whose size and mtime match its cache entry isn't even opened, and one whose
+// contents hash the same is read but not parsed; neither is one whose contents were already compiled
+// into another file's binary of the same load. contentHash is set whenever true is returned.
+static bool CompileAssetFile(const AssetFormat& format, const IndexedFile& file, const DialogCache* cache,
+    std::vector<uint8_t>& binary, uint64_t& contentHash, LoadTimings* timings = nullptr, CompiledContents* contents = nullptr) {
+    const DialogCache::Entry* cached = cache ? cache->Find(GetCacheKey(file)) : nullptr;
+    if (cached && cached->size == file.size && cached->writeTime == file.writeTime) {
+        binary = cached->binary;
+        contentHash = cached->contentHash;
+        totalTimings.cached++;
+        if (timings) timings->cached++;
+        return true;
+    }
+
+    try {
+        // Reused between files so reading doesn't allocate once the buffer has grown.
+        thread_local std::string source;
+        auto start = std::chrono::steady_clock::now();
+        ReadDialogFile(file.path.string(), source);
+        contentHash = XXH64(source.data(), source.size());
+        int64_t readNs = ElapsedNs(start);
+        totalTimings.readNs += readNs;
+        if (timings) timings->readNs += readNs;
+
+        if (cached && cached->contentHash == contentHash && cached->size == source.size()) {
+            binary = cached->binary;
+            totalTimings.cached++;
+            if (timings) timings->cached++;
+            return true;
+        }
+        if (const std::vector<uint8_t>* duplicate = contents ? contents->Find(contentHash, source.size()) : nullptr) {
+            binary = *duplicate;
+            totalTimings.duplicates++;
+            if (timings) timings->duplicates++;
+            return true;
+        }
+
+        start = std::chrono::steady_clock::now();
+        CompileAsset(source, format, binary);
+        int64_t parseNs = ElapsedNs(start);
+        totalTimings.parseNs += parseNs;
+        totalTimings.parsed++;
+        if (timings) {
+            timings->parseNs += parseNs;
+            timings->parsed++;
+        }
+        if (contents) contents->Add(contentHash, source.size(), &binary);
+        return true;
+    } catch (const std::exception& e) {
+        printf("[ProxyBK_DialogLoader] Error loading %s: %s\n", file.path.string().c_str(), e.what());
+        return false;
+    }
+}
+
+static bool CompileAssetFile(const AssetFormat& format, const fs::path& filePath, std::vector<uint8_t>& binary) {
+    IndexedFile file;
+    file.path = filePath;
+    uint64_t contentHash;
+    return CompileAssetFile(format, file, nullptr, binary, contentHash);
+}
 
-            current_section->push_back(bkstr);
+static void WriteCache(const fs::path& cachePath, const std::vector<std::pair<int32_t, IndexedFile>>& files,
+    const std::vector<std::vector<uint8_t>>& binaries, const std::vector<uint64_t>& contentHashes, const std::vector<uint8_t>& compiled) {
+    DialogCache cache;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!compiled[i]) continue;
+        const IndexedFile& file = files[i].second;
+        cache.Set(GetCacheKey(file), DialogCache::Entry{ file.size, file.writeTime, contentHashes[i], binaries[i] });
+    }
+    if (!cache.Save(cachePath, COMPILER_VERSION, compressedStorage)) {
+        printf("[ProxyBK_DialogLoader] Failed to write %s\n", cachePath.string().c_str());
+    }
+}
+
+// State of a RefreshAll running in the background. Lookups use it to compile an ID on demand
+// when it's requested before the pool got to it.
+struct AsyncLoad {
+    enum : uint8_t { PENDING, CLAIMED, DONE };
+
+    std::vector<std::pair<int32_t, IndexedFile>> files;
+    std::unordered_map<int32_t, size_t> positions;
+    uint64_t fingerprint = 0;
+    // Root of the language being loaded, where the pack and cache are written once it's done.
+    fs::path root;
+    DialogCache cache;
+    // Per file: who owns binaries[i] (whoever moved it out of PENDING), whether it compiled, and
+    // whether a Debug Mode refresh replaced it so the loader mustn't publish over it.
+    std::unique_ptr<std::atomic<uint8_t>[]> states;
+    std::unique_ptr<std::atomic<uint8_t>[]> overridden;
+    std::vector<std::vector<uint8_t>> binaries;
+    std::vector<uint64_t> contentHashes;
+    std::vector<uint8_t> compiled;
+    CompiledContents contents;
+    std::atomic<bool> skipPack{false};
+    std::atomic<bool> cancelled{false};
+    // Held while checking overridden and cancelled and publishing an entry, and while setting
+    // either of them, so a refresh or a cancel can't land between the check and the publish and
+    // then be overwritten by the stale entry.
+    std::mutex publishMutex;
+    LoadTimings timings;
+    std::chrono::steady_clock::time_point started;
+
+    // Whether its task got a worker, and whether it's done. A load cancelled before it started is
+    // skipped when its task runs, so nobody waits for it: the canceller may hold the only worker.
+    std::mutex finishedMutex;
+    std::condition_variable finishedCondition;
+    bool running = false;
+    bool finished = false;
+};
+
+static std::shared_ptr<AsyncLoad> GetAsyncLoad(AssetLoader& loader) {
+    if (!loader.asyncLoading.load(std::memory_order_acquire)) return nullptr;
+    std::lock_guard<std::mutex> lock(loader.asyncLoadMutex);
+    return loader.asyncLoad;
+}
+
+// Stops any background load and waits for its in-flight files, so it can't publish stale entries
+// on top of whatever the caller is about to do. Never waits on a load whose task hasn't started, so
+// it's safe on a pool worker.
+static void CancelAsyncLoad(AssetLoader& loader) {
+    std::shared_ptr<AsyncLoad> load;
+    {
+        std::lock_guard<std::mutex> lock(loader.asyncLoadMutex);
+        load = std::move(loader.asyncLoad);
+        loader.asyncLoading = false;
+    }
+    if (!load) return;
+
+    {
+        std::lock_guard<std::mutex> lock(load->publishMutex);
+        load->cancelled = true;
+    }
+    std::unique_lock<std::mutex> lock(load->finishedMutex);
+    load->finishedCondition.wait(lock, [&] { return load->finished || !load->running; });
+}
+
+// Tells a running background load that textId was refreshed from its source, so it neither
+// publishes its own copy afterwards nor bakes it into the pack.
+static void OverrideAsyncLoadEntry(AssetLoader& loader, int32_t textId) {
+    std::shared_ptr<AsyncLoad> load = GetAsyncLoad(loader);
+    if (!load) return;
+    auto it = load->positions.find(textId);
+    if (it != load->positions.end()) {
+        std::lock_guard<std::mutex> lock(load->publishMutex);
+        load->overridden[it->second] = 1;
+        load->skipPack = true;
+    }
+}
+
+// Publishes binary for files[i] unless a refresh replaced that entry or the load was cancelled.
+static void PublishAsyncLoadEntry(AssetLoader& loader, AsyncLoad& load, size_t i, const std::vector<uint8_t>& binary) {
+    std::lock_guard<std::mutex> lock(load.publishMutex);
+    if (!load.overridden[i] && !load.cancelled) {
+        loader.store.Set(load.files[i].first, binary);
+    }
+}
+
+// Compiles files[i] if nobody else has claimed it yet. Returns false if it was already claimed.
+static bool CompileAsyncLoadEntry(AssetLoader& loader, AsyncLoad& load, size_t i, LoadTimings* timings) {
+    uint8_t expected = AsyncLoad::PENDING;
+    if (!load.states[i].compare_exchange_strong(expected, AsyncLoad::CLAIMED)) return false;
+
+    load.compiled[i] = CompileAssetFile(loader.format, load.files[i].second, &load.cache, load.binaries[i], load.contentHashes[i], timings,
+        &load.contents);
+    if (load.compiled[i]) {
+        PublishAsyncLoadEntry(loader, load, i, load.binaries[i]);
+    }
+    load.states[i] = AsyncLoad::DONE;
+    return true;
+}
+
+static bool CompileOnDemand(AssetLoader& loader, int32_t textId) {
+    std::shared_ptr<AsyncLoad> load = GetAsyncLoad(loader);
+    if (!load) return false;
+    auto it = load->positions.find(textId);
+    if (it == load->positions.end()) return false;
+
+    size_t i = it->second;
+    if (CompileAsyncLoadEntry(loader, *load, i, nullptr)) return load->compiled[i];
+    if (load->states[i] == AsyncLoad::DONE) return false;
+
+    // A pool thread is working on it right now; compile a private copy rather than wait for it. If
+    // a refresh got in first, the store already has the newer entry.
+    std::vector<uint8_t> binary;
+    if (!CompileAssetFile(loader.format, load->files[i].second.path, binary)) return false;
+    PublishAsyncLoadEntry(loader, *load, i, binary);
+    return true;
+}
+
+// Recompiles textId from filePath, or drops it if filePath is empty or doesn't compile, and
+// publishes the result over the async loader and the pack. Caller must hold refreshMutex.
+static void ReloadAsset(AssetLoader& loader, int32_t textId, const fs::path& filePath) {
+    OverrideAsyncLoadEntry(loader, textId);
+    GetPacks(loader).compiled.Hide(textId);
+
+    std::vector<uint8_t> binary;
+    if (!filePath.empty() && CompileAssetFile(loader.format, filePath, binary)) {
+        loader.store.Set(textId, binary);
+    } else {
+        loader.store.Erase(textId);
+    }
+}
+
+static void RefreshAsset(AssetLoader& loader, int32_t textId) {
+    // The watcher already applies every change as soon as it's saved, there's nothing to refresh.
+    if (loader.watcher.IsRunning()) return;
+
+    auto start = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    AssetIndex& index = loader.index;
+    auto it = index.files.find(textId);
+    if (it == index.files.end() || !fs::exists(it->second.path)) {
+        // Only rescan when a directory actually changed, so misses for IDs without a
+        // replacement file cost a handful of stats rather than a walk of the whole tree.
+        if (IsAssetIndexStale(loader)) {
+            RebuildAssetIndex(loader);
+            it = index.files.find(textId);
         }
     }
 
-    return result;
+    ReloadAsset(loader, textId, it != index.files.end() ? it->second.path : fs::path());
+    loader.stats.refreshes.Record(uint64_t(ElapsedNs(start)));
 }
 
-static std::vector<uint8_t> ConvertUTF8ToLatin1(const std::vector<uint8_t>& input) {
-    std::vector<uint8_t> result;
-    
-    for (size_t i = 0; i < input.size(); ++i) {
-        uint8_t byte = input[i];
-        
-        // ASCII range (0x00-0x7F): pass through as-is
-        if (byte < 0x80) {
-            result.push_back(byte);
+// Which layer of index filePath is in, or -1. Layers can be nested in one another, so the deepest
+// folder wins.
+static int32_t FindAssetLayer(const AssetIndex& index, const fs::path& filePath) {
+    std::string path = filePath.generic_string();
+    int32_t found = -1;
+    size_t foundLength = 0;
+    for (uint32_t layer = 0; layer < index.layers.size(); layer++) {
+        std::string prefix = index.layers[layer].folderPath.generic_string() + '/';
+        if (prefix.size() > foundLength && path.compare(0, prefix.size(), prefix) == 0) {
+            found = int32_t(layer);
+            foundLength = prefix.size();
         }
-        // UTF-8 2-byte sequence for Latin-1 supplement (0xC2-0xC3)
-        else if ((byte == 0xC2 || byte == 0xC3) && i + 1 < input.size()) {
-            uint8_t next_byte = input[i + 1];
-            
-            // Validate that it's a valid UTF-8 continuation byte (0x80-0xBF)
-            if ((next_byte & 0xC0) == 0x80) {
-                // Decode UTF-8 to Unicode code point
-                uint32_t codepoint = ((byte & 0x1F) << 6) | (next_byte & 0x3F);
-                
-                // Code points 0x80-0xFF map directly to ISO-8859-1
-                if (codepoint >= 0x80 && codepoint <= 0xFF) {
-                    result.push_back(static_cast<uint8_t>(codepoint));
-                    i++; // Skip the continuation byte
+    }
+    return found;
+}
+
+// Takes filePath out of the files textId's winner shadows. Caller must hold indexMutex.
+static void RemoveShadowedFile(AssetIndex& index, int32_t textId, const fs::path& filePath) {
+    auto it = index.shadowed.find(textId);
+    if (it == index.shadowed.end()) return;
+    std::vector<IndexedFile>& candidates = it->second;
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](const IndexedFile& candidate) {
+        return candidate.path == filePath;
+    }), candidates.end());
+    if (candidates.empty()) index.shadowed.erase(it);
+}
+
+static void OnAssetFilesChanged(AssetLoader& loader, const std::vector<fs::path>& changed) {
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    AssetIndex& index = loader.index;
+    for (const fs::path& filePath : changed) {
+        int32_t textId;
+        if (filePath.extension() != loader.format.extension) continue;
+        // Changes a watcher saw in the previous language's folder right before a switch restarted it.
+        int32_t layer = FindAssetLayer(index, filePath);
+        if (layer < 0) continue;
+        if (!ParseTextId(filePath, textId)) continue;
+
+        std::error_code ec;
+        auto it = index.files.find(textId);
+        if (fs::is_regular_file(filePath, ec)) {
+            IndexedFile file = MakeIndexedFile(index, uint32_t(layer), filePath, fs::file_size(filePath, ec),
+                fs::last_write_time(filePath, ec).time_since_epoch().count());
+            bool wins = it == index.files.end() || it->second.path == filePath || Outranks(index, file, it->second);
+            {
+                std::unique_lock<std::shared_mutex> indexLock(loader.indexMutex);
+                RemoveShadowedFile(index, textId, filePath);
+                if (!wins) {
+                    AddShadowedFile(index, textId, std::move(file));
+                } else if (it == index.files.end()) {
+                    index.files.emplace(textId, std::move(file));
                 } else {
-                    // Shouldn't happen with 0xC2-0xC3, but handle gracefully
-                    result.push_back('?'); // Replacement character
-                    i++;
+                    if (it->second.path != filePath) AddShadowedFile(index, textId, std::move(it->second));
+                    it->second = std::move(file);
+                }
+            }
+            // A file another layer overrides doesn't change what the game sees.
+            if (!wins) continue;
+            ReloadAsset(loader, textId, filePath);
+            printf("[ProxyBK_DialogLoader] Reloaded %s\n", filePath.string().c_str());
+        } else {
+            if (it == index.files.end() || it->second.path != filePath) {
+                std::unique_lock<std::shared_mutex> indexLock(loader.indexMutex);
+                RemoveShadowedFile(index, textId, filePath);
+                continue;
+            }
+
+            // Falls back to the best file the removed one was overriding that's still there.
+            fs::path fallbackPath;
+            {
+                std::unique_lock<std::shared_mutex> indexLock(loader.indexMutex);
+                index.files.erase(it);
+                auto shadowed = index.shadowed.find(textId);
+                if (shadowed != index.shadowed.end()) {
+                    std::vector<IndexedFile>& candidates = shadowed->second;
+                    auto candidate = candidates.begin();
+                    while (candidate != candidates.end() && !fs::is_regular_file(candidate->path, ec)) ++candidate;
+                    if (candidate != candidates.end()) {
+                        fallbackPath = candidate->path;
+                        index.files.emplace(textId, std::move(*candidate));
+                        ++candidate;
+                    }
+                    candidates.erase(candidates.begin(), candidate);
+                    if (candidates.empty()) index.shadowed.erase(shadowed);
                 }
+            }
+            ReloadAsset(loader, textId, fallbackPath);
+            if (fallbackPath.empty()) {
+                printf("[ProxyBK_DialogLoader] Removed %s\n", filePath.string().c_str());
             } else {
-                // Invalid UTF-8 sequence
-                result.push_back('?');
+                printf("[ProxyBK_DialogLoader] Removed %s, using %s\n", filePath.string().c_str(), fallbackPath.string().c_str());
             }
         }
-        // UTF-8 3+ byte sequences: not representable in ISO-8859-1
-        else if ((byte & 0xE0) == 0xC0) {
-            // 2-byte sequence but not Latin-1 range
-            result.push_back('?');
-            if (i + 1 < input.size() && (input[i + 1] & 0xC0) == 0x80) {
-                i++; // Skip continuation byte
+    }
+}
+
+static void LogLoadTimings(const AssetFormat& format, const char* mode, size_t loaded, size_t total, int64_t enumerateNs,
+    int64_t compileNs, const LoadTimings& timings, int64_t publishNs) {
+    printf("[ProxyBK_DialogLoader] %s loaded %zu/%zu %s (%zu from cache, %zu duplicates) in %.2f ms: enumerate %.2f ms, "
+        "compile %.2f ms on %zu threads (read %.2f ms, parse %.2f ms of thread time), publish %.2f ms\n",
+        mode, loaded, total, format.description, timings.cached.load(), timings.duplicates.load(), NsToMs(enumerateNs + compileNs + publishNs),
+        NsToMs(enumerateNs), NsToMs(compileNs), GetThreadPool().GetThreadCount(), NsToMs(timings.readNs),
+        NsToMs(timings.parseNs), NsToMs(publishNs));
+}
+
+// Opens the pack the loader wrote at packPath if it's current and stored the way entries are stored
+// now, so turning compression on or off rewrites it on the next load.
+static bool OpenCompiledPack(DialogPack& pack, const fs::path& packPath, uint64_t fingerprint) {
+    if (!pack.Open(packPath, fingerprint)) return false;
+    if (pack.IsCompressed() == compressedStorage) return true;
+    pack.Close();
+    return false;
+}
+
+static void WritePack(const fs::path& packPath, uint64_t fingerprint, const std::vector<std::pair<int32_t, const std::vector<uint8_t>*>>& binaries) {
+    if (!DialogPack::Write(packPath, fingerprint, binaries, compressedStorage)) {
+        printf("[ProxyBK_DialogLoader] Failed to write %s\n", packPath.string().c_str());
+    }
+}
+
+// The result of compiling a whole asset folder, before it's published.
+struct CompiledAssets {
+    std::vector<std::vector<uint8_t>> binaries;
+    std::vector<uint64_t> contentHashes;
+    std::vector<uint8_t> compiled;
+    CompiledContents contents;
+    // The files that compiled, pointing into binaries.
+    std::vector<std::pair<int32_t, const std::vector<uint8_t>*>> loaded;
+    LoadTimings timings;
+    int64_t compileNs = 0;
+};
+
+// Compiles every file on the thread pool, reusing what the cache under root still has.
+static void CompileAllAssets(const AssetFormat& format, const fs::path& root,
+    const std::vector<std::pair<int32_t, IndexedFile>>& files, CompiledAssets& result) {
+    auto start = std::chrono::steady_clock::now();
+    DialogCache cache;
+    cache.Load(GetCachePath(root, format), COMPILER_VERSION);
+    result.binaries.resize(files.size());
+    result.contentHashes.resize(files.size());
+    result.compiled.assign(files.size(), 0);
+    GetThreadPool().ParallelFor(files.size(), [&](size_t i) {
+        result.compiled[i] = CompileAssetFile(format, files[i].second, &cache, result.binaries[i], result.contentHashes[i], &result.timings,
+            &result.contents);
+    });
+
+    result.loaded.reserve(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        if (result.compiled[i]) result.loaded.emplace_back(files[i].first, &result.binaries[i]);
+    }
+    result.compileNs = ElapsedNs(start);
+}
+
+// Writes the pack and cache under root, so the next load can skip compiling.
+static void SaveCompiledAssets(const AssetFormat& format, const fs::path& root, const std::vector<std::pair<int32_t, IndexedFile>>& files,
+    uint64_t fingerprint, const CompiledAssets& result) {
+    WritePack(GetPackPath(root, format), fingerprint, result.loaded);
+    WriteCache(GetCachePath(root, format), files, result.binaries, result.contentHashes, result.compiled);
+}
+
+// Publishes nothing but the index: every indexed ID starts out as an evicted store entry, so its
+// first lookup compiles the file the way it would bring back one the memory budget evicted. No pack
+// or cache is written, as there's never a point where everything is compiled. Caller must hold
+// refreshMutex.
+static void DeferAllAssets(AssetLoader& loader) {
+    std::vector<int32_t> textIds;
+    textIds.reserve(loader.index.files.size());
+    for (const auto& entry : loader.index.files) {
+        textIds.push_back(entry.first);
+    }
+    loader.store.ReplaceEvicted(textIds);
+}
+
+static void LogDeferredAssets(const AssetFormat& format, const char* mode, size_t count, int64_t enumerateNs) {
+    printf("[ProxyBK_DialogLoader] %s indexed %zu %s in %.2f ms, compiling each on first use\n", mode, count,
+        format.description, NsToMs(enumerateNs));
+}
+
+// Compiles every indexed file on the thread pool and swaps the results into the store in one go,
+// so lookups never observe a half-built map. Caller must hold refreshMutex.
+static void LoadAllAssets(AssetLoader& loader, const std::vector<std::pair<int32_t, IndexedFile>>& files,
+    uint64_t fingerprint, int64_t enumerateNs) {
+    fs::path root = GetLanguageRoot(currentLanguage);
+    CompiledAssets result;
+    CompileAllAssets(loader.format, root, files, result);
+
+    auto start = std::chrono::steady_clock::now();
+    loader.store.Replace(result.loaded);
+    int64_t publishNs = ElapsedNs(start);
+
+    LogLoadTimings(loader.format, "Synchronously", result.loaded.size(), files.size(), enumerateNs, result.compileNs,
+        result.timings, publishNs);
+
+    SaveCompiledAssets(loader.format, root, files, fingerprint, result);
+}
+
+// Same as LoadAllAssets, but returns right away. Each file is published as soon as it's
+// compiled; anything requested earlier is compiled on demand by the lookup.
+static void StartAsyncLoad(AssetLoader& loader, std::vector<std::pair<int32_t, IndexedFile>> files,
+    uint64_t fingerprint, int64_t enumerateNs) {
+    auto load = std::make_shared<AsyncLoad>();
+    load->files = std::move(files);
+    load->fingerprint = fingerprint;
+    size_t count = load->files.size();
+    load->positions.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        load->positions.emplace(load->files[i].first, i);
+    }
+    load->states = std::make_unique<std::atomic<uint8_t>[]>(count);
+    load->overridden = std::make_unique<std::atomic<uint8_t>[]>(count);
+    for (size_t i = 0; i < count; i++) {
+        load->states[i] = AsyncLoad::PENDING;
+        load->overridden[i] = 0;
+    }
+    load->binaries.resize(count);
+    load->contentHashes.resize(count);
+    load->compiled.resize(count, 0);
+    load->root = GetLanguageRoot(currentLanguage);
+    load->cache.Load(GetCachePath(load->root, loader.format), COMPILER_VERSION);
+    load->started = std::chrono::steady_clock::now();
+
+    loader.store.Clear();
+    {
+        std::lock_guard<std::mutex> lock(loader.asyncLoadMutex);
+        loader.asyncLoad = load;
+        loader.asyncLoading = true;
+    }
+
+    GetThreadPool().Submit([&loader, load, enumerateNs] {
+        {
+            std::lock_guard<std::mutex> lock(load->finishedMutex);
+            if (load->cancelled) return;
+            load->running = true;
+        }
+
+        size_t count = load->files.size();
+        GetThreadPool().ParallelFor(count, [&](size_t i) {
+            if (load->cancelled) return;
+            CompileAsyncLoadEntry(loader, *load, i, &load->timings);
+        });
+
+        if (!load->cancelled) {
+            // On-demand compiles on the game thread may still be finishing the last few entries.
+            for (size_t i = 0; i < count; i++) {
+                while (load->states[i] != AsyncLoad::DONE) {
+                    std::this_thread::yield();
+                }
+            }
+
+            std::vector<std::pair<int32_t, const std::vector<uint8_t>*>> loaded;
+            loaded.reserve(count);
+            for (size_t i = 0; i < count; i++) {
+                if (load->compiled[i]) loaded.emplace_back(load->files[i].first, &load->binaries[i]);
+            }
+            LogLoadTimings(loader.format, "Asynchronously", loaded.size(), count, enumerateNs,
+                ElapsedNs(load->started), load->timings, 0);
+
+            if (!load->skipPack) {
+                WritePack(GetPackPath(load->root, loader.format), load->fingerprint, loaded);
+                WriteCache(GetCachePath(load->root, loader.format), load->files, load->binaries, load->contentHashes, load->compiled);
             }
         }
-        else if ((byte & 0xF0) == 0xE0) {
-            // 3-byte sequence
-            result.push_back('?');
-            if (i + 1 < input.size() && (input[i + 1] & 0xC0) == 0x80) i++;
-            if (i + 1 < input.size() && (input[i + 1] & 0xC0) == 0x80) i++;
-        }
-        else if ((byte & 0xF8) == 0xF0) {
-            // 4-byte sequence
-            result.push_back('?');
-            if (i + 1 < input.size() && (input[i + 1] & 0xC0) == 0x80) i++;
-            if (i + 1 < input.size() && (input[i + 1] & 0xC0) == 0x80) i++;
-            if (i + 1 < input.size() && (input[i + 1] & 0xC0) == 0x80) i++;
-        }
-        else {
-            // Invalid UTF-8 or continuation byte in wrong position
-            result.push_back('?');
-        }
-    }
-    
-    return result;
-}
-
-std::vector<uint8_t> ConvertDialogToBytes(const Dialog& dialog) {
-    std::vector<uint8_t> out = {0x01, 0x03, 0x00};
-    
-    // Bottom texts
-    out.push_back(static_cast<uint8_t>(dialog.bottom.size()));
-    for (const auto& text : dialog.bottom) {
-        std::vector<uint8_t> converted = ConvertUTF8ToLatin1(text.string);
-        out.push_back(text.cmd);
-        out.push_back(static_cast<uint8_t>(converted.size() + 1)); // +1 for null terminator
-        out.insert(out.end(), converted.begin(), converted.end());
-        out.push_back(0x00);
-    }
-    
-    // Top texts
-    out.push_back(static_cast<uint8_t>(dialog.top.size()));
-    for (const auto& text : dialog.top) {
-        std::vector<uint8_t> converted = ConvertUTF8ToLatin1(text.string);
-        out.push_back(text.cmd);
-        out.push_back(static_cast<uint8_t>(converted.size() + 1)); // +1 for null terminator
-        out.insert(out.end(), converted.begin(), converted.end());
-        out.push_back(0x00);
-    }
-    
-    // Pad to 4-byte alignment for endianness swap
-    while (out.size() % 4 != 0) {
-        out.push_back(0);
-    }
-    
-    // Swap endianness (4-byte chunks)
-    for (size_t i = 0; i < out.size(); i += 4) {
-        std::swap(out[i + 0], out[i + 3]);
-        std::swap(out[i + 1], out[i + 2]);
-    }
-    
-    return out;
-}
-
-void RefreshDialog(int32_t textId) {
-    dialogMap.erase(textId);
-
-    // Convert textId to hex string for filename (padded to 4 chars)
-    std::stringstream ss;
-    ss << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << textId;
-    std::string fileName = ss.str() + ".dialog";
-    
-    fs::path dialogPath = MOD_FOLDER_PATH / "DialogLoader" / "dialog";
-    if (!fs::exists(dialogPath)) return;
-    
-    // Recursively search for the file
-    fs::path filePath;
-    bool found = false;
-    for (const auto& entry : fs::recursive_directory_iterator(dialogPath)) {
-        if (entry.is_regular_file() && entry.path().filename() == fileName) {
-            filePath = entry.path();
-            found = true;
-            break;
-        }
-    }
-    
-    if (!found) return;
 
-    try {
-        Dialog dialog = LoadDialogFromPath(filePath.string());
-        std::vector<uint8_t> binary = ConvertDialogToBytes(dialog);
+        {
+            std::lock_guard<std::mutex> lock(loader.asyncLoadMutex);
+            if (loader.asyncLoad == load) {
+                loader.asyncLoad = nullptr;
+                loader.asyncLoading = false;
+            }
+        }
+        std::lock_guard<std::mutex> lock(load->finishedMutex);
+        load->finished = true;
+        load->finishedCondition.notify_all();
+    });
+}
 
-        dialogMap[textId] = {};
-        size_t copySize = std::min(binary.size(), size_t(0x1000));
-        std::copy_n(binary.begin(), copySize, dialogMap[textId].begin());
-    } catch (const std::exception& e) {
-        printf("[ProxyBK_DialogLoader] Error loading %s: %s\n", filePath.string().c_str(), e.what());
+// Rebuilds the index of one asset folder and reloads it, from the pack when nothing changed.
+// Caller must hold refreshMutex.
+static void RefreshAllAssets(AssetLoader& loader) {
+    fs::path root = GetLanguageRoot(currentLanguage);
+    fs::path folderPath = GetFolderPath(root, loader.format);
+    if (!fs::exists(folderPath)) {
+        fs::create_directories(folderPath);
+    }
+
+    CancelAsyncLoad(loader);
+
+    auto start = std::chrono::steady_clock::now();
+    RebuildAssetIndex(loader);
+    std::vector<std::pair<int32_t, IndexedFile>> files(loader.index.files.begin(), loader.index.files.end());
+    int64_t enumerateNs = ElapsedNs(start);
+
+    auto packs = std::make_unique<AssetPacks>();
+    bool packCurrent = OpenCompiledPack(packs->compiled, GetPackPath(root, loader.format), loader.index.fingerprint);
+    if (packs->prebuilt.Open(GetPrebuiltPackPath(root, loader.format))) {
+        printf("[ProxyBK_DialogLoader] Serving %zu prebuilt %s from %s\n", packs->prebuilt.GetEntryCount(),
+            loader.format.description, GetPrebuiltPackPath(root, loader.format).string().c_str());
+    }
+    size_t packEntries = packs->compiled.GetEntryCount();
+    SetPacks(loader, std::move(packs));
+    if (packCurrent) {
+        // Nothing changed since the pack was written: serve straight from it and skip compiling.
+        loader.store.Clear();
+        printf("[ProxyBK_DialogLoader] Serving %zu %s from %s (enumerate %.2f ms)\n", packEntries,
+            loader.format.description, GetPackPath(root, loader.format).string().c_str(), NsToMs(enumerateNs));
+    } else if (lazyLoading) {
+        DeferAllAssets(loader);
+        LogDeferredAssets(loader.format, "Lazily", files.size(), enumerateNs);
+    } else if (asyncLoading) {
+        StartAsyncLoad(loader, std::move(files), loader.index.fingerprint, enumerateNs);
+    } else {
+        LoadAllAssets(loader, files, loader.index.fingerprint, enumerateNs);
+    }
+}
+
+// (Re)starts watching the current language's folder and the overlays for loader.
+static void StartWatcher(AssetLoader& loader) {
+    std::vector<fs::path> folderPaths;
+    {
+        std::lock_guard<std::mutex> lock(refreshMutex);
+        for (const AssetLayer& layer : GetAssetLayers(GetLanguageRoot(currentLanguage), loader.format)) {
+            folderPaths.push_back(layer.folderPath);
+        }
+    }
+    AssetLoader* target = &loader;
+    auto callback = [target](const std::vector<fs::path>& changed) { OnAssetFilesChanged(*target, changed); };
+    if (!loader.watcher.Start(folderPaths, callback)) {
+        printf("[ProxyBK_DialogLoader] Cannot watch %s\n", folderPaths[0].string().c_str());
+    }
+}
+
+// One kind of asset of a language, loaded off to the side while the current language keeps serving.
+struct PreparedAssets {
+    AssetIndex index;
+    std::unique_ptr<AssetPacks> packs = std::make_unique<AssetPacks>();
+    // Empty when the pack is current or the files are left for their first lookup to compile.
+    CompiledAssets compiled;
+    bool deferred = false;
+};
+
+// Loads everything under root for format without touching what's being served: straight from the
+// pack if it's current, otherwise by compiling every file and saving a new pack and cache, unless
+// lazy is set and that is left to the first lookup of each ID.
+static void PrepareAssets(const AssetFormat& format, const fs::path& root, bool lazy, PreparedAssets& prepared) {
+    fs::path folderPath = GetFolderPath(root, format);
+    std::error_code ec;
+    // Like RefreshAll, so there is something to watch even if the language doesn't replace this kind.
+    fs::create_directories(folderPath, ec);
+
+    auto start = std::chrono::steady_clock::now();
+    prepared.index = BuildAssetIndex(format, GetAssetLayers(root, format));
+    int64_t enumerateNs = ElapsedNs(start);
+    prepared.packs->prebuilt.Open(GetPrebuiltPackPath(root, format));
+    if (OpenCompiledPack(prepared.packs->compiled, GetPackPath(root, format), prepared.index.fingerprint)) return;
+    if (lazy) {
+        prepared.deferred = true;
+        LogDeferredAssets(format, "Before switching languages,", prepared.index.files.size(), enumerateNs);
+        return;
+    }
+
+    std::vector<std::pair<int32_t, IndexedFile>> files(prepared.index.files.begin(), prepared.index.files.end());
+    CompileAllAssets(format, root, files, prepared.compiled);
+    LogLoadTimings(format, "Before switching languages,", prepared.compiled.loaded.size(), files.size(), enumerateNs,
+        prepared.compiled.compileNs, prepared.compiled.timings, 0);
+    SaveCompiledAssets(format, root, files, prepared.index.fingerprint, prepared.compiled);
+}
+
+// Switches loader over to prepared. Every step replaces something that's still serving with its
+// finished counterpart, and the pack goes before the store: until the store is swapped too, an ID
+// is served from the old store or the new pack, never from neither. Caller must hold refreshMutex.
+static void PublishAssets(AssetLoader& loader, PreparedAssets& prepared) {
+    CancelAsyncLoad(loader);
+    {
+        std::unique_lock<std::shared_mutex> lock(loader.indexMutex);
+        loader.index = std::move(prepared.index);
+    }
+    SetPacks(loader, std::move(prepared.packs));
+    if (prepared.deferred) {
+        DeferAllAssets(loader);
+    } else {
+        loader.store.Replace(prepared.compiled.loaded);
+    }
+}
+
+// Loads every kind of asset for language on the thread pool and publishes them once they're all
+// ready. Returns false if the language has no folder.
+static bool SwitchLanguage(const std::string& language) {
+    fs::path root = GetLanguageRoot(language);
+    std::error_code ec;
+    if (!fs::is_directory(root, ec)) {
+        printf("[ProxyBK_DialogLoader] Cannot switch language: %s is not a folder\n", root.string().c_str());
+        return false;
+    }
+
+    uint32_t generation = ++languageGeneration;
+    GetThreadPool().Submit([language, root, generation, lazy = lazyLoading] {
+        auto start = std::chrono::steady_clock::now();
+        std::array<PreparedAssets, std::size(assetLoaders)> prepared;
+        for (size_t i = 0; i < prepared.size(); i++) {
+            if (languageGeneration != generation) return;
+            PrepareAssets(assetLoaders[i]->format, root, lazy, prepared[i]);
+        }
+
+        // refreshMutex is only taken for the publish step. This task can't run nested inside a holder
+        // of it, like a RefreshAll, because ParallelFor callers only ever run their own chunks. Holding
+        // it, the task must not wait on other pool work: the background load it cancels may be queued
+        // behind it on the same worker, which is why CancelAsyncLoad skips loads that haven't started.
+        {
+            std::lock_guard<std::mutex> lock(refreshMutex);
+            if (languageGeneration != generation) return;
+            currentLanguage = language;
+            for (size_t i = 0; i < prepared.size(); i++) {
+                PublishAssets(*assetLoaders[i], prepared[i]);
+            }
+        }
+        printf("[ProxyBK_DialogLoader] Switched to %s in %.2f ms\n", root.string().c_str(), NsToMs(ElapsedNs(start)));
+
+        std::lock_guard<std::mutex> lock(watcherMutex);
+        for (AssetLoader* loader : assetLoaders) {
+            if (loader->watcher.IsRunning()) StartWatcher(*loader);
+        }
+    });
+    return true;
+}
+
+// Recompiles an entry the memory budget evicted from the store, or one lazy loading hasn't compiled
+// yet, puts it back and copies it into dest like ReadAsset.
+static uint32_t RestoreAsset(AssetLoader& loader, int32_t textId, uint8_t* dest) {
+    IndexedFile file;
+    {
+        std::shared_lock<std::shared_mutex> lock(loader.indexMutex);
+        auto it = loader.index.files.find(textId);
+        if (it == loader.index.files.end()) return 0;
+        file = it->second;
+    }
+
+    std::vector<uint8_t> binary;
+    if (!CompileAssetFile(loader.format, file.path, binary)) return 0;
+    bool restored;
+    {
+        // A language switch may have published a new index and store while this was compiling, and
+        // the file then belongs to the old language; or a RefreshAll indexed a newer version of it.
+        std::shared_lock<std::shared_mutex> lock(loader.indexMutex);
+        auto it = loader.index.files.find(textId);
+        restored = it != loader.index.files.end() && it->second.path == file.path && it->second.size == file.size &&
+            it->second.writeTime == file.writeTime && loader.store.Restore(textId, binary);
+    }
+    if (!restored) {
+        // Reloaded or removed while this was compiling; whatever the store has now is newer.
+        uint32_t length = 0;
+        return loader.store.Get(textId, dest, length) ? length : 0;
+    }
+
+    // Copied from the local result, the budget may already have evicted it again.
+    uint32_t length = uint32_t(std::min(binary.size(), size_t(DialogStore::MAX_ENTRY_SIZE)));
+    if (dest != nullptr) {
+        std::copy_n(binary.data(), length, dest);
+    }
+    return length;
+}
+
+// Makes textId cheap to look up: claims and compiles it if a background load hasn't gotten to it
+// yet, compiles it if it's evicted or lazy loading left it for later, or faults its pack entry into
+// memory. Entries already in the store need nothing. Needs no lock: each of these checks again when
+// it publishes that what it compiled is still current.
+static void PrefetchAsset(AssetLoader& loader, AsyncLoad* load, int32_t textId) {
+    if (load != nullptr) {
+        auto it = load->positions.find(textId);
+        if (it != load->positions.end()) {
+            CompileAsyncLoadEntry(loader, *load, it->second, &load->timings);
+        }
+        return;
+    }
+    if (loader.store.WasEvicted(textId)) {
+        RestoreAsset(loader, textId, nullptr);
+        return;
+    }
+
+    EpochReclaimer::Guard guard;
+    uint32_t storedLength = 0;
+    if (const uint8_t* packed = GetPacks(loader).FindStored(textId, storedLength)) {
+        // One read per page is enough for the OS to map the whole entry in.
+        volatile uint8_t sink = 0;
+        for (uint32_t offset = 0; offset < storedLength; offset += 0x1000) {
+            sink = sink + packed[offset];
+        }
+        if (storedLength > 0) sink = sink + packed[storedLength - 1];
+    }
+}
+
+// Prefetches every indexed ID that filter accepts on the thread pool. Only the list of IDs is
+// taken under a lock; a RefreshAll, reload or language switch that happens while they compile wins
+// over whatever the prefetch would publish, see PrefetchAsset.
+static void StartPrefetch(AssetLoader& loader, std::function<bool(int32_t textId, const IndexedFile& file)> filter) {
+    GetThreadPool().Submit([&loader, filter = std::move(filter)] {
+        std::vector<int32_t> textIds;
+        {
+            std::shared_lock<std::shared_mutex> lock(loader.indexMutex);
+            for (const auto& [textId, file] : loader.index.files) {
+                if (filter(textId, file)) textIds.push_back(textId);
+            }
+        }
+
+        std::shared_ptr<AsyncLoad> load = GetAsyncLoad(loader);
+        GetThreadPool().ParallelFor(textIds.size(), [&](size_t i) {
+            PrefetchAsset(loader, load.get(), textIds[i]);
+        });
+    });
+}
+
+static uint32_t LookupAsset(AssetLoader& loader, int32_t textId, uint8_t* dest) {
+    uint32_t length = 0;
+    if (loader.store.Get(textId, dest, length)) return length;
+
+    EpochReclaimer::Guard guard;
+    const AssetPacks& packs = GetPacks(loader);
+    if ((length = packs.compiled.Read(textId, dest, DialogStore::MAX_ENTRY_SIZE)) > 0) return length;
+
+    if (CompileOnDemand(loader, textId) && loader.store.Get(textId, dest, length)) return length;
+    if (loader.store.WasEvicted(textId) && (length = RestoreAsset(loader, textId, dest)) > 0) return length;
+
+    // Only once it's certain the folder has no file of its own for textId.
+    return packs.prebuilt.Read(textId, dest, DialogStore::MAX_ENTRY_SIZE);
+}
+
+// Copies the replacement for textId into dest, if given, and returns its size. Only the real
+// payload is copied, rounded up to whole words; the rest of the guest buffer is left untouched.
+static uint32_t ReadAsset(AssetLoader& loader, int32_t textId, uint8_t* dest) {
+    auto start = std::chrono::steady_clock::now();
+    uint32_t length = LookupAsset(loader, textId, dest);
+    (length > 0 ? loader.stats.hits : loader.stats.misses).Record(uint64_t(ElapsedNs(start)));
+    return length;
+}
+
+// Copies the replacements for count text IDs into dest back to back, looking them all up in one
+// pass over the store. offsets has count + 1 entries: on entry offsets[count]
+// holds the size of dest, on return entry i occupies dest[offsets[i], offsets[i + 1]) and is empty
+// if there's no replacement or it didn't fit. Returns the number of entries copied.
+static uint32_t ReadAssetBatch(AssetLoader& loader, const int32_t* textIds, uint32_t count, uint8_t* dest, uint32_t* offsets) {
+    uint32_t capacity = offsets[count] & ~3u;
+
+    // Compile whatever a background load hasn't gotten to yet or the memory budget evicted first,
+    // so the pass only copies. After this everything is either in the store or in the
+    // pack, unless the budget is too small to hold the whole batch.
+    bool loading = GetAsyncLoad(loader) != nullptr;
+    for (uint32_t i = 0; i < count; i++) {
+        if (loading) {
+            CompileOnDemand(loader, textIds[i]);
+        }
+        if (loader.store.WasEvicted(textIds[i])) {
+            RestoreAsset(loader, textIds[i], nullptr);
+        }
     }
+
+    uint32_t used = 0;
+    uint32_t hits = 0;
+    EpochReclaimer::Guard guard;
+    const AssetPacks& packs = GetPacks(loader);
+    loader.store.GetBatch(textIds, count, [&](size_t i, const uint8_t* data, uint32_t length) {
+        offsets[i] = used;
+        if (data == nullptr) {
+            // Read straight into place, since pack entries may have to be decompressed, once it's
+            // certain the entry fits.
+            length = packs.Read(textIds[i], nullptr, DialogStore::MAX_ENTRY_SIZE);
+            if (length > 0 && length <= capacity - used && packs.Read(textIds[i], dest + used, length) == length) {
+                used += length;
+                hits++;
+            }
+            return;
+        }
+        if (length <= capacity - used) {
+            std::copy_n(data, length, dest + used);
+            used += length;
+            hits++;
+        }
+    });
+    offsets[count] = used;
+    return hits;
+}
+
+// Everything DialogLoader_GetStats and the stats log report, summed over every kind of asset.
+struct LoaderStats {
+    LatencyHistogram::Snapshot hits;
+    LatencyHistogram::Snapshot misses;
+    LatencyHistogram::Snapshot refreshes;
+    uint64_t refreshAllCount = 0;
+    int64_t lastRefreshAllNs = 0;
+    uint64_t parsed = 0;
+    uint64_t cached = 0;
+    uint64_t duplicates = 0;
+    int64_t readNs = 0;
+    int64_t parseNs = 0;
+    uint64_t storeEntries = 0;
+    uint64_t storeBlobs = 0;
+    uint64_t storeBytes = 0;
+    uint64_t packBytes = 0;
+    uint64_t indexedFiles = 0;
+};
+
+static LoaderStats CollectStats() {
+    LoaderStats stats;
+    for (AssetLoader* loader : assetLoaders) {
+        loader->stats.hits.AddTo(stats.hits);
+        loader->stats.misses.AddTo(stats.misses);
+        loader->stats.refreshes.AddTo(stats.refreshes);
+        stats.storeEntries += loader->store.GetEntryCount();
+        stats.storeBlobs += loader->store.GetDistinctCount();
+        stats.storeBytes += loader->store.GetResidentBytes();
+        EpochReclaimer::Guard guard;
+        stats.packBytes += GetPacks(*loader).GetMappedSize();
+        std::shared_lock<std::shared_mutex> lock(loader->indexMutex);
+        stats.indexedFiles += loader->index.files.size();
+    }
+    stats.refreshAllCount = refreshAllCount;
+    stats.lastRefreshAllNs = lastRefreshAllNs;
+    stats.parsed = totalTimings.parsed;
+    stats.cached = totalTimings.cached;
+    stats.duplicates = totalTimings.duplicates;
+    stats.readNs = totalTimings.readNs;
+    stats.parseNs = totalTimings.parseNs;
+    return stats;
+}
+
+static std::string FormatStats(const LoaderStats& stats) {
+    auto formatLatencies = [](const LatencyHistogram::Snapshot& latencies) {
+        char text[128];
+        snprintf(text, sizeof(text), "%llu (p50 %.1f us, p99 %.1f us, max %.1f us)", (unsigned long long)latencies.count,
+            latencies.GetPercentile(0.5) / 1000.0, latencies.GetPercentile(0.99) / 1000.0, latencies.max / 1000.0);
+        return std::string(text);
+    };
+
+    char text[384];
+    snprintf(text, sizeof(text), "; RefreshAll %llu (last %.2f ms); compiled %llu files (%llu more from cache, %llu duplicates, "
+        "read %.2f ms, parse %.2f ms); %llu entries (%llu distinct) in %llu bytes of stores, %llu bytes of packs mapped; "
+        "%llu files indexed",
+        (unsigned long long)stats.refreshAllCount, NsToMs(stats.lastRefreshAllNs), (unsigned long long)stats.parsed,
+        (unsigned long long)stats.cached, (unsigned long long)stats.duplicates, NsToMs(stats.readNs), NsToMs(stats.parseNs),
+        (unsigned long long)stats.storeEntries, (unsigned long long)stats.storeBlobs, (unsigned long long)stats.storeBytes,
+        (unsigned long long)stats.packBytes, (unsigned long long)stats.indexedFiles);
+    return "hits " + formatLatencies(stats.hits) + "; misses " + formatLatencies(stats.misses) + "; refreshes " +
+        formatLatencies(stats.refreshes) + text;
 }
 
 extern "C" {
@@ -239,27 +1561,227 @@ extern "C" {
 DLLEXPORT uint32_t recomp_api_version = 1;
 
 DLLEXPORT void DialogLoader_RefreshAll(uint8_t* rdram, recomp_context* ctx) {
-    dialogMap.clear();
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(refreshMutex);
+
+        fs::path mainPath = MOD_FOLDER_PATH / "DialogLoader";
+        if (!fs::exists(mainPath)) {
+            fs::create_directories(mainPath);
+        }
+
+        for (AssetLoader* loader : assetLoaders) {
+            RefreshAllAssets(*loader);
+        }
+        refreshAllCount++;
+        lastRefreshAllNs = ElapsedNs(start);
+    }
+
+    // Watch the folders of overlays added since the watchers started.
+    if (overlaysChanged.exchange(false)) {
+        std::lock_guard<std::mutex> lock(watcherMutex);
+        for (AssetLoader* loader : assetLoaders) {
+            if (loader->watcher.IsRunning()) StartWatcher(*loader);
+        }
+    }
+
+    _return(ctx, 0);
+}
+
+// Layers the folder a0, relative to the mods folder, over or under DialogLoader/: it has the same
+// dialog/, quiz_q/ and grunty_q/ subfolders, and where both have a file for a text ID, the one with
+// the higher priority a1 wins. DialogLoader/ (or the current language) has priority 0 and wins ties;
+// between overlays of the same priority, the one added first wins. Adding a folder again changes
+// its priority. Only the files of an overlay are read, never its packs. Takes effect on the next
+// refresh or language switch. Returns 0 if a0 isn't a folder inside the mods folder.
+DLLEXPORT void DialogLoader_AddOverlay(uint8_t* rdram, recomp_context* ctx) {
+    fs::path root = fs::path(_arg_string<0>(rdram, ctx)).lexically_normal();
+    int32_t priority = _arg<1, int32_t>(rdram, ctx);
+    if (!root.has_filename()) root = root.parent_path();
+
+    // Nothing that could point outside the mods folder.
+    if (root.empty() || root.has_root_path() || *root.begin() == "..") {
+        printf("[ProxyBK_DialogLoader] Invalid overlay folder %s\n", root.string().c_str());
+        _return(ctx, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(overlayMutex);
+        auto it = std::find_if(overlayRoots.begin(), overlayRoots.end(), [&](const OverlayRoot& overlay) {
+            return overlay.root == root;
+        });
+        if (it != overlayRoots.end()) {
+            it->priority = priority;
+        } else {
+            overlayRoots.push_back(OverlayRoot{ root, priority });
+        }
+    }
+    overlaysChanged = true;
+
+    _return(ctx, 1);
+}
+
+// Removes every folder added with DialogLoader_AddOverlay. Takes effect on the next refresh or
+// language switch.
+DLLEXPORT void DialogLoader_ClearOverlays(uint8_t* rdram, recomp_context* ctx) {
+    {
+        std::lock_guard<std::mutex> lock(overlayMutex);
+        overlayRoots.clear();
+    }
+    overlaysChanged = true;
+
+    _return(ctx, 0);
+}
+
+DLLEXPORT void DialogLoader_SetAsyncLoading(uint8_t* rdram, recomp_context* ctx) {
+    asyncLoading = _arg<0, int32_t>(rdram, ctx) != 0;
+
+    _return(ctx, 0);
+}
+
+// Makes RefreshAll, and language switches, only index the files and compile each one the first
+// time its ID is looked up, for sessions that only ever show a small part of the text. A current
+// .pack is still served directly. Takes effect on the next refresh.
+DLLEXPORT void DialogLoader_SetLazyLoading(uint8_t* rdram, recomp_context* ctx) {
+    lazyLoading = _arg<0, int32_t>(rdram, ctx) != 0;
+
+    _return(ctx, 0);
+}
 
-    fs::path mainPath = MOD_FOLDER_PATH / "DialogLoader";
-    if (!fs::exists(mainPath)) {
-        fs::create_directories(mainPath);
+// Keeps compiled entries LZ4-compressed in memory and in the .pack and .cache files, decompressing
+// each one straight into the guest buffer when it's read, if a0 is nonzero. Costs well under a
+// microsecond per text box. Entries that don't get smaller are kept as they are. Takes effect on the
+// next refresh, which also rewrites the pack in the new form.
+DLLEXPORT void DialogLoader_SetCompression(uint8_t* rdram, recomp_context* ctx) {
+    compressedStorage = _arg<0, int32_t>(rdram, ctx) != 0;
+    for (AssetLoader* loader : assetLoaders) {
+        loader->store.SetCompression(compressedStorage);
     }
 
-    fs::path dialogPath = mainPath / "dialog";
-    if (!fs::exists(dialogPath)) {
-        fs::create_directories(dialogPath);
+    _return(ctx, 0);
+}
+
+// Starts or stops watching the asset folders. While watching, saved changes are compiled and
+// published right away and the per-ID refreshes do nothing, so Debug Mode costs no file access per text box.
+DLLEXPORT void DialogLoader_SetWatchDialogFolder(uint8_t* rdram, recomp_context* ctx) {
+    bool enabled = _arg<0, int32_t>(rdram, ctx) != 0;
+
+    std::lock_guard<std::mutex> lock(watcherMutex);
+    for (AssetLoader* loader : assetLoaders) {
+        if (enabled) {
+            StartWatcher(*loader);
+        } else {
+            loader->watcher.Stop();
+        }
     }
 
-    for (const auto& entry : fs::recursive_directory_iterator(dialogPath)) {
-        if (!entry.is_regular_file()) continue;
-        fs::path filePath = entry.path();
-        if (filePath.extension() != ".dialog") continue;
+    _return(ctx, 0);
+}
 
-        std::string fileName = filePath.stem().string();
-        int32_t textId = std::stoi(fileName, nullptr, 16);
+// Caps the memory used by compiled entries to a0 bytes per kind of text, 0 for no limit. Entries
+// over the budget are evicted, least recently used first, and compiled again when next requested.
+DLLEXPORT void DialogLoader_SetMemoryBudget(uint8_t* rdram, recomp_context* ctx) {
+    uint32_t bytes = _arg<0, uint32_t>(rdram, ctx);
 
-        RefreshDialog(textId);
+    for (AssetLoader* loader : assetLoaders) {
+        loader->store.SetBudget(bytes);
+    }
+
+    _return(ctx, 0);
+}
+
+// Writes the dialog store's counters to a0 as words: hits, misses, evictions, resident entries and
+// resident bytes. Counters wrap around at 32 bits.
+DLLEXPORT void DialogLoader_GetDialogCacheStats(uint8_t* rdram, recomp_context* ctx) {
+    uint32_t* dest = _arg<0, uint32_t*>(rdram, ctx);
+
+    DialogStore::Stats stats = dialogLoader.store.GetStats();
+    dest[0] = uint32_t(stats.hits);
+    dest[1] = uint32_t(stats.misses);
+    dest[2] = uint32_t(stats.evictions);
+    dest[3] = uint32_t(dialogLoader.store.GetEntryCount());
+    dest[4] = uint32_t(dialogLoader.store.GetResidentBytes());
+
+    _return(ctx, 0);
+}
+
+// Switches to the language in DialogLoader/languages/<a0>, or back to the files directly under
+// DialogLoader/ if a0 is empty. The new language is loaded in the background while the current one
+// keeps serving, then takes over all at once. Returns 0 if there is no such language.
+DLLEXPORT void DialogLoader_SetLanguage(uint8_t* rdram, recomp_context* ctx) {
+    std::string language = _arg_string<0>(rdram, ctx);
+
+    // Only a plain folder name, nothing that could point outside languages/.
+    if (language.find_first_of("/\\:") != std::string::npos || language == "." || language == "..") {
+        printf("[ProxyBK_DialogLoader] Invalid language name %s\n", language.c_str());
+        _return(ctx, 0);
+        return;
+    }
+
+    _return(ctx, SwitchLanguage(language) ? 1 : 0);
+}
+
+// Writes what the loader has cost so far to a0, as words, summed over dialogs and questions:
+//   0  lookups that found a replacement
+//   1  lookups that didn't
+//   2  lookup time for hits, median, in ns
+//   3  lookup time for hits, 99th percentile, in ns
+//   4  lookup time for hits, maximum, in ns
+//   5-7  the same for misses
+//   8  per-ID refreshes that went to the file system
+//   9-11  their median, 99th percentile and maximum time in us
+//  12  RefreshAll calls
+//  13  time the last RefreshAll took in us
+//  14  files parsed
+//  15  files taken from the .cache instead
+//  16  total time spent reading files in us
+//  17  total time spent parsing and encoding them in us
+//  18  bytes held by the stores
+//  19  bytes of .pack files mapped
+//  20  indexed files
+// Percentiles are accurate to within 12.5%. Values saturate at 0xFFFFFFFF. Batch lookups only
+// show up in DialogLoader_GetDialogCacheStats.
+DLLEXPORT void DialogLoader_GetStats(uint8_t* rdram, recomp_context* ctx) {
+    uint32_t* dest = _arg<0, uint32_t*>(rdram, ctx);
+
+    auto saturate = [](uint64_t value) { return uint32_t(std::min<uint64_t>(value, UINT32_MAX)); };
+    auto writeLatencies = [&](uint32_t* out, const LatencyHistogram::Snapshot& latencies, uint64_t unit) {
+        out[0] = saturate(latencies.GetPercentile(0.5) / unit);
+        out[1] = saturate(latencies.GetPercentile(0.99) / unit);
+        out[2] = saturate(latencies.max / unit);
+    };
+
+    LoaderStats stats = CollectStats();
+    dest[0] = saturate(stats.hits.count);
+    dest[1] = saturate(stats.misses.count);
+    writeLatencies(dest + 2, stats.hits, 1);
+    writeLatencies(dest + 5, stats.misses, 1);
+    dest[8] = saturate(stats.refreshes.count);
+    writeLatencies(dest + 9, stats.refreshes, 1000);
+    dest[12] = saturate(stats.refreshAllCount);
+    dest[13] = saturate(uint64_t(stats.lastRefreshAllNs) / 1000);
+    dest[14] = saturate(stats.parsed);
+    dest[15] = saturate(stats.cached);
+    dest[16] = saturate(uint64_t(stats.readNs) / 1000);
+    dest[17] = saturate(uint64_t(stats.parseNs) / 1000);
+    dest[18] = saturate(stats.storeBytes);
+    dest[19] = saturate(stats.packBytes);
+    dest[20] = saturate(stats.indexedFiles);
+
+    _return(ctx, 0);
+}
+
+// Appends the same numbers as DialogLoader_GetStats to DialogLoader/stats.log every a0 seconds, or
+// stops if a0 is 0.
+DLLEXPORT void DialogLoader_SetStatsLogInterval(uint8_t* rdram, recomp_context* ctx) {
+    uint32_t seconds = _arg<0, uint32_t>(rdram, ctx);
+
+    if (seconds == 0) {
+        statsLog.Stop();
+    } else {
+        statsLog.Start(MOD_FOLDER_PATH / "DialogLoader" / "stats.log", std::chrono::seconds(seconds),
+            [] { return FormatStats(CollectStats()); });
     }
 
     _return(ctx, 0);
@@ -276,7 +1798,7 @@ DLLEXPORT void DialogLoader_SetModsFolderPath(uint8_t* rdram, recomp_context* ct
 DLLEXPORT void DialogLoader_RefreshDialog(uint8_t* rdram, recomp_context* ctx) {
     int32_t textId = _arg<0, int32_t>(rdram, ctx);
 
-    RefreshDialog(textId);
+    RefreshAsset(dialogLoader, textId);
 
     _return(ctx, 0);
 }
@@ -284,7 +1806,15 @@ DLLEXPORT void DialogLoader_RefreshDialog(uint8_t* rdram, recomp_context* ctx) {
 DLLEXPORT void DialogLoader_RefreshQuizQ(uint8_t* rdram, recomp_context* ctx) {
     int32_t quizQId = _arg<0, int32_t>(rdram, ctx);
 
-    // RefreshQuizQ(quizQId);
+    RefreshAsset(quizQLoader, quizQId);
+
+    _return(ctx, 0);
+}
+
+DLLEXPORT void DialogLoader_RefreshGruntyQ(uint8_t* rdram, recomp_context* ctx) {
+    int32_t gruntyQId = _arg<0, int32_t>(rdram, ctx);
+
+    RefreshAsset(gruntyQLoader, gruntyQId);
 
     _return(ctx, 0);
 }
@@ -293,21 +1823,94 @@ DLLEXPORT void DialogLoader_GetDialog(uint8_t* rdram, recomp_context* ctx) {
     int32_t textId = _arg<0, int32_t>(rdram, ctx);
     void* dest = _arg<1, void*>(rdram, ctx);
 
-    if (dialogMap.count(textId) > 0) {
-        uint8_t* dest_bytes = (uint8_t*)dest;
-        const auto& src = dialogMap[textId];
-        std::copy(src.begin(), src.end(), dest_bytes);
+    if (ReadAsset(dialogLoader, textId, (uint8_t*)dest) > 0) {
         _return(ctx, 1);
     } else {
         _return(ctx, 0);
     }
 }
 
+// Size in bytes of the replacement GetDialog would copy for a text ID, or 0 if there is none.
+DLLEXPORT void DialogLoader_GetDialogLength(uint8_t* rdram, recomp_context* ctx) {
+    int32_t textId = _arg<0, int32_t>(rdram, ctx);
+
+    _return(ctx, ReadAsset(dialogLoader, textId, nullptr));
+}
+
+// Fetches several dialogs in one call: a0 is an array of a1 text IDs, a2 the destination buffer (word
+// aligned) and a3 an array of a1 + 1 offsets whose last entry holds the size of the buffer. Dialog i
+// ends up at a2 + offsets[i] and is offsets[i + 1] - offsets[i] bytes long, 0 if there is no
+// replacement or it didn't fit. Returns how many dialogs were copied.
+DLLEXPORT void DialogLoader_GetDialogBatch(uint8_t* rdram, recomp_context* ctx) {
+    const int32_t* textIds = _arg<0, int32_t*>(rdram, ctx);
+    uint32_t count = _arg<1, uint32_t>(rdram, ctx);
+    uint8_t* dest = _arg<2, uint8_t*>(rdram, ctx);
+    uint32_t* offsets = _arg<3, uint32_t*>(rdram, ctx);
+
+    _return(ctx, ReadAssetBatch(dialogLoader, textIds, count, dest, offsets));
+}
+
+// Gets every dialog with a text ID in [a0, a1] ready in the background, so the first text box of a
+// scene doesn't wait on parsing. Returns right away.
+DLLEXPORT void DialogLoader_PrefetchDialogRange(uint8_t* rdram, recomp_context* ctx) {
+    int32_t firstId = _arg<0, int32_t>(rdram, ctx);
+    int32_t lastId = _arg<1, int32_t>(rdram, ctx);
+
+    StartPrefetch(dialogLoader, [firstId, lastId](int32_t textId, const IndexedFile&) {
+        return textId >= firstId && textId <= lastId;
+    });
+
+    _return(ctx, 0);
+}
+
+// Same as DialogLoader_PrefetchDialogRange for every dialog under a subfolder of the dialog folder,
+// e.g. "mumbos_mountain", for translations that group their files by level or scene.
+DLLEXPORT void DialogLoader_PrefetchDialogFolder(uint8_t* rdram, recomp_context* ctx) {
+    std::string prefix = fs::path(_arg_string<0>(rdram, ctx)).generic_string();
+    while (!prefix.empty() && prefix.back() == '/') {
+        prefix.pop_back();
+    }
+    prefix += '/';
+
+    StartPrefetch(dialogLoader, [prefix](int32_t, const IndexedFile& file) {
+        return file.relativePath.compare(0, prefix.size(), prefix) == 0;
+    });
+
+    _return(ctx, 0);
+}
+
 DLLEXPORT void DialogLoader_GetQuizQ(uint8_t* rdram, recomp_context* ctx) {
     int32_t quizQId = _arg<0, int32_t>(rdram, ctx);
     void* dest = _arg<1, void*>(rdram, ctx);
 
-    _return(ctx, 0);
+    if (ReadAsset(quizQLoader, quizQId, (uint8_t*)dest) > 0) {
+        _return(ctx, 1);
+    } else {
+        _return(ctx, 0);
+    }
+}
+
+DLLEXPORT void DialogLoader_GetQuizQLength(uint8_t* rdram, recomp_context* ctx) {
+    int32_t quizQId = _arg<0, int32_t>(rdram, ctx);
+
+    _return(ctx, ReadAsset(quizQLoader, quizQId, nullptr));
+}
+
+DLLEXPORT void DialogLoader_GetGruntyQ(uint8_t* rdram, recomp_context* ctx) {
+    int32_t gruntyQId = _arg<0, int32_t>(rdram, ctx);
+    void* dest = _arg<1, void*>(rdram, ctx);
+
+    if (ReadAsset(gruntyQLoader, gruntyQId, (uint8_t*)dest) > 0) {
+        _return(ctx, 1);
+    } else {
+        _return(ctx, 0);
+    }
+}
+
+DLLEXPORT void DialogLoader_GetGruntyQLength(uint8_t* rdram, recomp_context* ctx) {
+    int32_t gruntyQId = _arg<0, int32_t>(rdram, ctx);
+
+    _return(ctx, ReadAsset(gruntyQLoader, gruntyQId, nullptr));
 }
 
 }
@@ -0,0 +1,144 @@
+#include "lz4.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+// The format requires the last 5 bytes to be literals, and the last match to start at least 12
+// bytes before the end.
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MATCH_FIND_LIMIT = 12;
+constexpr size_t MAX_OFFSET = 0xFFFF;
+constexpr size_t HASH_BITS = 12;
+
+uint32_t Read32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Writes the part of a length that doesn't fit in its 4 bits of the token.
+uint8_t* WriteLength(uint8_t* out, size_t length) {
+    for (; length >= 255; length -= 255) {
+        *out++ = 255;
+    }
+    *out++ = uint8_t(length);
+    return out;
+}
+
+uint8_t* WriteSequence(uint8_t* out, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength) {
+    uint8_t* token = out++;
+    *token = uint8_t(std::min<size_t>(literalLength, 15) << 4);
+    if (literalLength >= 15) out = WriteLength(out, literalLength - 15);
+    if (literalLength > 0) memcpy(out, literals, literalLength);
+    out += literalLength;
+    if (matchLength == 0) return out;
+
+    *out++ = uint8_t(offset);
+    *out++ = uint8_t(offset >> 8);
+    matchLength -= MIN_MATCH;
+    *token |= uint8_t(std::min<size_t>(matchLength, 15));
+    if (matchLength >= 15) out = WriteLength(out, matchLength - 15);
+    return out;
+}
+
+// Reads the rest of a length whose 4 bits in the token were all set. Returns false past the end.
+bool ReadLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (in == end) return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+}
+
+size_t LZ4CompressBlock(const uint8_t* input, size_t length, uint8_t* output) {
+    uint8_t* out = output;
+    size_t anchor = 0;
+    if (length > MATCH_FIND_LIMIT) {
+        // Position + 1 of the last sequence seen with each hash, 0 for none.
+        uint32_t table[1 << HASH_BITS] = {};
+        size_t matchEnd = length - LAST_LITERALS;
+        size_t position = 0;
+        while (position + MATCH_FIND_LIMIT < length) {
+            uint32_t sequence = Read32(input + position);
+            uint32_t& slot = table[Hash(sequence)];
+            size_t candidate = slot;
+            slot = uint32_t(position + 1);
+            if (candidate == 0 || position - (candidate - 1) > MAX_OFFSET || Read32(input + candidate - 1) != sequence) {
+                position++;
+                continue;
+            }
+
+            size_t match = candidate - 1;
+            // Take back literals the match also covers.
+            while (position > anchor && match > 0 && input[position - 1] == input[match - 1]) {
+                position--;
+                match--;
+            }
+            size_t matchLength = MIN_MATCH;
+            while (position + matchLength < matchEnd && input[match + matchLength] == input[position + matchLength]) {
+                matchLength++;
+            }
+
+            out = WriteSequence(out, input + anchor, position - anchor, position - match, matchLength);
+            position += matchLength;
+            anchor = position;
+        }
+    }
+    out = WriteSequence(out, input + anchor, length - anchor, 0, 0);
+    return size_t(out - output);
+}
+
+size_t LZ4DecompressBlock(const uint8_t* input, size_t length, uint8_t* output, size_t capacity) {
+    const uint8_t* in = input;
+    const uint8_t* end = input + length;
+    size_t written = 0;
+    while (in < end) {
+        uint8_t token = *in++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(in, end, literalLength)) return SIZE_MAX;
+        if (literalLength > size_t(end - in)) return SIZE_MAX;
+        if (literalLength >= capacity - written) {
+            if (capacity > written) memcpy(output + written, in, capacity - written);
+            return capacity;
+        }
+        if (literalLength > 0) memcpy(output + written, in, literalLength);
+        in += literalLength;
+        written += literalLength;
+        // The last sequence has no match.
+        if (in == end) break;
+
+        if (end - in < 2) return SIZE_MAX;
+        size_t offset = size_t(in[0]) | size_t(in[1]) << 8;
+        in += 2;
+        if (offset == 0 || offset > written) return SIZE_MAX;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(in, end, matchLength)) return SIZE_MAX;
+        matchLength += MIN_MATCH;
+
+        size_t copied = std::min(matchLength, capacity - written);
+        uint8_t* dest = output + written;
+        const uint8_t* source = dest - offset;
+        if (offset >= copied) {
+            memcpy(dest, source, copied);
+        } else {
+            // Overlapping, e.g. a run of padding: each byte depends on one just written.
+            for (size_t i = 0; i < copied; i++) {
+                dest[i] = source[i];
+            }
+        }
+        written += copied;
+        if (written == capacity) return capacity;
+    }
+    return written;
+}
@@ -0,0 +1,71 @@
+// Tests for DialogCache. Built and run by `make test`.
+#include "dialog_cache.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+size_t failures = 0;
+
+void Check(bool condition, const char* message) {
+    if (!condition) {
+        printf("FAIL: %s\n", message);
+        failures++;
+    }
+}
+
+DialogCache MakeCache() {
+    DialogCache cache;
+    cache.Set("0400.dialog", DialogCache::Entry{ 10, 20, 30, std::vector<uint8_t>(64, 0x41) });
+    cache.Set("level/0401.dialog", DialogCache::Entry{ 11, 21, 31, { 0x01, 0x03, 0x00, 0x00 } });
+    return cache;
+}
+
+void TestRoundTrip(const fs::path& path, bool compress) {
+    Check(MakeCache().Save(path, 7, compress), "saves");
+    DialogCache cache;
+    Check(cache.Load(path, 7), "loads what it saved");
+    Check(cache.GetEntryCount() == 2, "keeps every entry");
+    const DialogCache::Entry* entry = cache.Find("0400.dialog");
+    Check(entry != nullptr && entry->size == 10 && entry->writeTime == 20 && entry->contentHash == 30 &&
+        entry->binary == std::vector<uint8_t>(64, 0x41), "keeps an entry's fields");
+}
+
+// Binaries compiled by another version of the compiler may differ from what it gives now.
+void TestOtherCompilerVersion(const fs::path& path) {
+    Check(MakeCache().Save(path, 7), "saves");
+    DialogCache cache;
+    Check(!cache.Load(path, 8), "a cache from another compiler version is discarded");
+    Check(cache.GetEntryCount() == 0, "nothing is kept from it");
+}
+
+// Versions 1 and 2 had no compiler version in the header.
+void TestOldFormat(const fs::path& path) {
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        uint32_t header[] = { 1, 0 };
+        file.write("DLCC", 4);
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+    DialogCache cache;
+    Check(!cache.Load(path, 0), "a cache in an older format is discarded");
+}
+
+}
+
+int main() {
+    fs::path path = fs::temp_directory_path() / ("dialogloader-cache-test-" + std::to_string(std::random_device()()) + ".cache");
+    TestRoundTrip(path, false);
+    TestRoundTrip(path, true);
+    TestOtherCompilerVersion(path);
+    TestOldFormat(path);
+    std::error_code ec;
+    fs::remove(path, ec);
+
+    printf("dialog_cache_test: %zu failure(s)\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+// Tests for dialog_decompiler: decompiles the binaries in tests/fixtures/decompiler (the ones named
+// 0B68, 1200 and 1300 in the game's byte order, the others in the ROM's), compares the results with
+// the files they were compiled from and compiles those back to the same bytes. Built and run by
+// `make test`, from the repository's root.
+#define DIALOG_DECOMPILER_NO_MAIN
+#include "../tools/dialog_decompiler.cpp"
+
+#include <random>
+
+namespace {
+
+size_t failures = 0;
+
+void Check(bool condition, const std::string& message) {
+    if (!condition) {
+        printf("FAIL: %s\n", message.c_str());
+        failures++;
+    }
+}
+
+std::string ReadText(const fs::path& filePath) {
+    std::ifstream file(filePath, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Decompiles every binary found under input and checks each against expected/<kind>/<text ID>.<kind>.
+void CheckDecompiles(const fs::path& input, const fs::path& expected) {
+    for (AssetLoader* loader : assetLoaders) {
+        const AssetFormat& format = loader->format;
+        std::map<int32_t, Binary> binaries;
+        Check(CollectBinaries(format, input, binaries) == 0, input.string() + ": collects " + format.folder + " without errors");
+        Check(binaries.size() == 2, input.string() + ": finds both " + format.folder + " binaries");
+
+        for (const auto& [textId, binary] : binaries) {
+            std::string name = binary.source;
+            DecompiledFile result;
+            if (!DecompileAsset(binary.bytes, format, result)) {
+                Check(false, name + ": decompiles: " + result.error);
+                continue;
+            }
+            std::string source = ReadText(GetFolderPath(expected, format) / (FormatTextId(textId) + format.extension));
+            Check(result.contents == source, name + ": decompiles to the file it was compiled from");
+
+            VerifyAsset(binary.bytes, format, result);
+            Check(result.verified, name + ": compiles back to the same bytes " + result.error);
+
+            std::vector<uint8_t> compiled;
+            CompileAsset(source, format, compiled);
+            Check(compiled == binary.bytes, name + ": the source compiles to the fixture");
+        }
+    }
+}
+
+// The same binaries read from a .prebuilt.pack, compressed, and a .pack, plain.
+void TestPacks(const fs::path& fixtures) {
+    fs::path root = fs::temp_directory_path() / ("dialogloader-decompiler-test-" + std::to_string(std::random_device()()));
+    fs::create_directories(root);
+    for (AssetLoader* loader : assetLoaders) {
+        const AssetFormat& format = loader->format;
+        std::map<int32_t, Binary> binaries;
+        CollectBinaries(format, fixtures, binaries);
+        std::vector<std::pair<int32_t, const std::vector<uint8_t>*>> entries;
+        for (const auto& [textId, binary] : binaries) entries.emplace_back(textId, &binary.bytes);
+
+        auto middle = entries.begin() + entries.size() / 2;
+        std::vector<std::pair<int32_t, const std::vector<uint8_t>*>> prebuilt(entries.begin(), middle);
+        std::vector<std::pair<int32_t, const std::vector<uint8_t>*>> packed(middle, entries.end());
+        Check(DialogPack::Write(GetPrebuiltPackPath(root, format), 0, prebuilt, true), "writes a prebuilt pack");
+        Check(DialogPack::Write(GetPackPath(root, format), 0, packed, false), "writes a pack");
+    }
+    CheckDecompiles(root, fixtures / "expected");
+
+    std::error_code ec;
+    fs::remove_all(root, ec);
+}
+
+// Binaries the text format can't hold, or that aren't well-formed, are errors rather than files
+// that compile to something else.
+void TestRejects() {
+    auto decompile = [](std::vector<uint8_t> bytes) {
+        bytes.resize((bytes.size() + 3) & ~size_t(3), 0);
+        SwapWords(bytes.data(), bytes.size());
+        DecompiledFile result;
+        return DecompileAsset(bytes, DIALOG_FORMAT, result);
+    };
+    Check(decompile({ 0x01, 0x03, 0x00, 0x00, 0x01, 0x80, 0x03, 'h', 'i', 0x00 }), "a well-formed dialog decompiles");
+    Check(!decompile({ 0x01, 0x03, 0x00, 0x00, 0x01, 0x80, 0x03, 'h', '\n', 0x00 }), "a line break is rejected");
+    Check(!decompile({ 0x01, 0x03, 0x00, 0x00, 0x01, 0x80, 0x03, '"', '\'', 0x00 }), "both kinds of quotes are rejected");
+    Check(!decompile({ 0x01, 0x03, 0x00, 0x00, 0x01, 0x80, 0x09, 'h', 'i', 0x00 }), "a length past the end is rejected");
+    Check(!decompile({ 0x01, 0x03, 0x00, 0x00, 0x02, 0x80, 0x03, 'h', 'i', 0x00 }), "a missing entry is rejected");
+    Check(!decompile({ 0x01, 0x03, 0x00, 0x00, 0x01, 0x80, 0x03, 'h', 'i', 0x00, 0x07 }), "trailing bytes are rejected");
+    Check(!decompile({ 0x01, 0x01, 0x02, 0x00 }), "another kind's header is rejected");
+}
+
+}
+
+int main(int argc, char** argv) {
+    fs::path fixtures = argc > 1 ? fs::path(argv[1]) : fs::path("tests/fixtures/decompiler");
+    CheckDecompiles(fixtures, fixtures / "expected");
+    TestPacks(fixtures);
+    TestRejects();
+    printf("dialog_decompiler_test: %zu failure(s)\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,44 @@
+// The game's side of the loader's exports, for the tests and dialog_bench, which drive them the way
+// the game does: its memory and the registers arguments are passed in.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mod_recomp.h"
+
+class FakeGuest {
+public:
+    using Export = void (*)(uint8_t* rdram, recomp_context* ctx);
+
+    static constexpr uint32_t STRING_ADDRESS = 0x1000;
+    static constexpr uint32_t BUFFER_ADDRESS = 0x10000;
+
+    FakeGuest() : rdram(1 << 20) {}
+
+    uint32_t Call(Export function, uint64_t a0 = 0, uint64_t a1 = 0, uint64_t a2 = 0, uint64_t a3 = 0) {
+        recomp_context ctx{};
+        ctx.r4 = a0;
+        ctx.r5 = a1;
+        ctx.r6 = a2;
+        ctx.r7 = a3;
+        function(rdram.data(), &ctx);
+        return uint32_t(ctx.r2);
+    }
+
+    // Stores text the way the game's byte-swapped memory holds it and returns its address.
+    uint64_t WriteString(const std::string& text, uint32_t offset = STRING_ADDRESS) {
+        for (size_t i = 0; i <= text.size(); i++) {
+            rdram[(offset + i) ^ 3] = i < text.size() ? uint8_t(text[i]) : 0;
+        }
+        return ToAddress(offset);
+    }
+
+    static uint64_t ToAddress(uint32_t offset) {
+        return 0xFFFFFFFF80000000ull + offset;
+    }
+
+private:
+    std::vector<uint8_t> rdram;
+};
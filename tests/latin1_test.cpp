@@ -0,0 +1,82 @@
+// Tests for ConvertUTF8ToLatin1: fixed cases, then random input checked against the scalar decoder
+// so the SSE2, AVX2 and NEON paths can't drift from it. Built and run by `make test`.
+#include "latin1.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+size_t failures = 0;
+
+void Check(bool condition, const char* message) {
+    if (!condition) {
+        printf("FAIL: %s\n", message);
+        failures++;
+    }
+}
+
+std::string Convert(const std::string& text) {
+    std::string output(text.size(), '\0');
+    size_t length = ConvertUTF8ToLatin1(reinterpret_cast<const uint8_t*>(text.data()), text.size(),
+        reinterpret_cast<uint8_t*>(output.data()));
+    output.resize(length);
+    return output;
+}
+
+void TestKnownText() {
+    Check(Convert("") == "", "empty text");
+    Check(Convert("Hello there, bear!") == "Hello there, bear!", "ASCII is copied");
+    Check(Convert("Caf\xC3\xA9 \xC2\xA9") == "Caf\xE9 \xA9", "Latin-1 supplement is decoded");
+    Check(Convert("\xE2\x80\x9CHi\xE2\x80\x9D") == "?Hi?", "characters outside Latin-1 become one '?'");
+    Check(Convert("\xF0\x9F\x98\x80!") == "?!", "4-byte sequences become one '?'");
+    Check(Convert("\xC3" "A") == "?A", "a lead byte without its continuation becomes '?'");
+    Check(Convert("\x80\xBF") == "??", "stray continuation bytes become '?' each");
+    Check(Convert("ab\xC3") == "ab?", "a truncated sequence at the end becomes '?'");
+
+    // Long enough for the vector paths, with the sequence straddling a block boundary.
+    std::string ascii(31, 'x');
+    Check(Convert(ascii + "\xC3\xA9" + ascii + ascii) == ascii + "\xE9" + ascii + ascii, "sequences across blocks");
+}
+
+// Mostly ASCII with some of the bytes that matter to the decoder sprinkled in, or fully random bytes,
+// at lengths on both sides of the 16 and 32 byte blocks and the 64 byte AVX2 cutoff.
+void TestMatchesScalar() {
+    static const uint8_t SPECIAL[] = { 'a', ' ', '"', 0x00, 0x7F, 0x80, 0xBF, 0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xDF,
+        0xE0, 0xE2, 0xEF, 0xF0, 0xF4, 0xF7, 0xF8, 0xFF, 0xA9, 0x82 };
+    std::mt19937_64 rng(7);
+    size_t mismatches = 0;
+    for (size_t round = 0; round < 500000; round++) {
+        size_t length = rng() % 300;
+        size_t density = rng() % 4;
+        std::vector<uint8_t> input(length);
+        for (uint8_t& byte : input) {
+            if (density == 0) byte = uint8_t(rng());
+            else if (rng() % (density * 8) == 0) byte = SPECIAL[rng() % std::size(SPECIAL)];
+            else byte = uint8_t('a' + rng() % 26);
+        }
+
+        // One byte past the end to catch writes beyond length.
+        std::vector<uint8_t> expected(length + 1, 0xEE);
+        std::vector<uint8_t> output(length + 1, 0xEE);
+        size_t expectedLength = ConvertUTF8ToLatin1Scalar(input.data(), length, expected.data());
+        size_t outputLength = ConvertUTF8ToLatin1(input.data(), length, output.data());
+        bool same = outputLength == expectedLength && output[length] == 0xEE &&
+            std::equal(expected.begin(), expected.begin() + expectedLength, output.begin());
+        if (!same) mismatches++;
+    }
+    Check(mismatches == 0, "the vector paths match the scalar decoder");
+}
+
+}
+
+int main() {
+    TestKnownText();
+    TestMatchesScalar();
+    printf("latin1_test: %zu failure(s)\n", failures);
+    return failures > 0 ? 1 : 0;
+}
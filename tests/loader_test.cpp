@@ -0,0 +1,124 @@
+// Tests for the loader's exports, driven the way the game calls them. Built and run by `make test`.
+//
+// Compiled as one translation unit with loader.cpp, like the benchmark.
+#include "../src/loader.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+#include "fake_guest.hpp"
+
+namespace {
+
+size_t failures = 0;
+
+void Check(bool condition, const char* message) {
+    if (!condition) {
+        printf("FAIL: %s\n", message);
+        failures++;
+    }
+}
+
+// Ends the test if it hangs, which is how a deadlock shows up.
+void StartWatchdog(std::chrono::seconds limit) {
+    std::thread([limit] {
+        std::this_thread::sleep_for(limit);
+        printf("FAIL: timed out, the loader deadlocked\n");
+        fflush(stdout);
+        std::_Exit(1);
+    }).detach();
+}
+
+constexpr int32_t FIRST_ID = 0x0400;
+constexpr size_t FILES = 2000;
+
+// Writes FILES dialogs into folder, with text that says which language they belong to.
+void WriteDialogs(const fs::path& folder, const std::string& language) {
+    fs::create_directories(folder);
+    for (size_t i = 0; i < FILES; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "%04X.dialog", unsigned(FIRST_ID + i));
+        std::ofstream(folder / name, std::ios::binary) << "type: Dialog\nbottom:\ntop:\n  - { cmd: 0x80, string: \""
+            << language << " " << i << "\" }\n  - { cmd: 0x04 }\n";
+    }
+}
+
+// A game-thread RefreshAll holds refreshMutex while its compiles run on the pool, where prefetches
+// it queued earlier also wait for that lock.
+void TestPrefetchDuringRefreshAll(FakeGuest& guest) {
+    for (size_t round = 0; round < 20; round++) {
+        guest.Call(DialogLoader_RefreshAll);
+        for (size_t i = 0; i < 8; i++) {
+            guest.Call(DialogLoader_PrefetchDialogRange, FIRST_ID, FIRST_ID + FILES);
+        }
+        guest.Call(DialogLoader_RefreshAll);
+    }
+    Check(guest.Call(DialogLoader_GetDialogLength, FIRST_ID) > 0, "dialogs are loaded after prefetching");
+}
+
+// The language switch task publishes under refreshMutex, which RefreshAll holds while it compiles.
+void TestSetLanguageDuringRefreshAll(FakeGuest& guest) {
+    for (size_t round = 0; round < 20; round++) {
+        guest.Call(DialogLoader_SetLanguage, guest.WriteString(round % 2 == 0 ? "fr" : "", 0x1800));
+        guest.Call(DialogLoader_RefreshAll);
+    }
+    Check(guest.Call(DialogLoader_GetDialogLength, FIRST_ID) > 0, "dialogs are loaded after switching languages");
+}
+
+// Waits until the language switch to language has published.
+void WaitForLanguage(const std::string& language) {
+    for (bool switched = false; !switched; std::this_thread::yield()) {
+        std::lock_guard<std::mutex> lock(refreshMutex);
+        switched = currentLanguage == language;
+    }
+}
+
+// In async mode the switch task cancels the background load RefreshAll queued on the pool after it,
+// and must not wait for it while it holds a worker (the only one on a single-core machine). Removing
+// the packs makes every RefreshAll start a background load.
+void TestSetLanguageDuringAsyncLoad(FakeGuest& guest, const fs::path& root) {
+    for (size_t round = 0; round < 20; round++) {
+        std::string language = round % 2 == 0 ? "fr" : "";
+        guest.Call(DialogLoader_SetLanguage, guest.WriteString(language, 0x1800));
+        std::error_code ec;
+        for (const fs::directory_entry& entry : fs::recursive_directory_iterator(root, ec)) {
+            if (entry.path().extension() == ".pack") fs::remove(entry.path(), ec);
+        }
+        guest.Call(DialogLoader_RefreshAll);
+        WaitForLanguage(language);
+    }
+    Check(guest.Call(DialogLoader_GetDialogLength, FIRST_ID) > 0, "dialogs are loaded after switching languages during async loads");
+}
+
+}
+
+int main() {
+    StartWatchdog(std::chrono::seconds(120));
+
+    // A folder of its own, so removing it afterwards can't touch anything else.
+    fs::path root = fs::temp_directory_path() / ("dialogloader-test-" + std::to_string(std::random_device()()));
+    WriteDialogs(root / "DialogLoader" / "dialog", "en");
+    WriteDialogs(root / "DialogLoader" / "languages" / "fr" / "dialog", "fr");
+
+    FakeGuest guest;
+    guest.Call(DialogLoader_SetModsFolderPath, guest.WriteString(root.string()));
+    TestPrefetchDuringRefreshAll(guest);
+    TestSetLanguageDuringRefreshAll(guest);
+    guest.Call(DialogLoader_SetLazyLoading, 1);
+    TestPrefetchDuringRefreshAll(guest);
+    TestSetLanguageDuringRefreshAll(guest);
+    guest.Call(DialogLoader_SetLazyLoading, 0);
+    guest.Call(DialogLoader_SetAsyncLoading, 1);
+    TestSetLanguageDuringAsyncLoad(guest, root);
+
+    // Let a last language switch finish before its files go away.
+    guest.Call(DialogLoader_SetLanguage, guest.WriteString("fr", 0x1800));
+    WaitForLanguage("fr");
+    std::error_code ec;
+    fs::remove_all(root, ec);
+
+    printf("loader_test: %zu failure(s)\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+// Tests for ThreadPool::ParallelFor. Built and run by `make test`.
+#include "thread_pool.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+size_t failures = 0;
+
+void Check(bool condition, const char* message) {
+    if (!condition) {
+        printf("FAIL: %s\n", message);
+        failures++;
+    }
+}
+
+// Ends the test if it hangs, which is how a deadlock shows up.
+void StartWatchdog(std::chrono::seconds limit) {
+    std::thread([limit] {
+        std::this_thread::sleep_for(limit);
+        printf("FAIL: timed out, ParallelFor deadlocked\n");
+        fflush(stdout);
+        std::_Exit(1);
+    }).detach();
+}
+
+void TestEveryIndexRunsOnce(ThreadPool& pool) {
+    for (size_t count : { size_t(1), size_t(7), size_t(1000), size_t(100003) }) {
+        std::vector<std::atomic<int>> runs(count);
+        pool.ParallelFor(count, [&](size_t i) { runs[i]++; });
+        bool once = std::all_of(runs.begin(), runs.end(), [](const std::atomic<int>& run) { return run == 1; });
+        Check(once, "every index runs exactly once");
+    }
+}
+
+void TestNestedInsidePoolTasks(ThreadPool& pool) {
+    std::atomic<size_t> total{0};
+    std::atomic<size_t> finished{0};
+    constexpr size_t TASKS = 16;
+    for (size_t t = 0; t < TASKS; t++) {
+        pool.Submit([&] {
+            pool.ParallelFor(100, [&](size_t) { total++; });
+            finished++;
+        });
+    }
+    while (finished < TASKS) std::this_thread::yield();
+    Check(total == TASKS * 100, "ParallelFor inside pool tasks runs everything");
+}
+
+// A caller holding a lock while a task that takes the same lock is queued, like RefreshAll holding
+// refreshMutex while a prefetch or language switch waits for it. The caller must not pick that task
+// up while it helps with its own chunks.
+void TestLockHoldingCallerSkipsOtherTasks(ThreadPool& pool) {
+    std::mutex lock;
+    for (size_t round = 0; round < 200; round++) {
+        std::atomic<size_t> ran{0};
+        {
+            std::lock_guard<std::mutex> held(lock);
+            for (size_t t = 0; t < 4; t++) {
+                pool.Submit([&] {
+                    std::lock_guard<std::mutex> taken(lock);
+                    ran++;
+                });
+            }
+            std::atomic<size_t> total{0};
+            pool.ParallelFor(64, [&](size_t) { total++; });
+            Check(total == 64, "ParallelFor under a lock runs everything");
+        }
+        while (ran < 4) std::this_thread::yield();
+    }
+}
+
+}
+
+int main() {
+    StartWatchdog(std::chrono::seconds(60));
+    for (size_t threads : { size_t(1), size_t(2), size_t(8) }) {
+        ThreadPool pool(threads);
+        TestEveryIndexRunsOnce(pool);
+        TestNestedInsidePoolTasks(pool);
+        TestLockHoldingCallerSkipsOtherTasks(pool);
+    }
+    printf("thread_pool_test: %zu failure(s)\n", failures);
+    return failures > 0 ? 1 : 0;
+}
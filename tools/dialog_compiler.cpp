@@ -0,0 +1,171 @@
+// Compiles a language folder (one with dialog/, quiz_q/ and grunty_q/ in it, like DialogLoader/ or
+// DialogLoader/languages/<name>/) ahead of time into the .prebuilt.pack files the loader serves
+// directly, so players don't pay for parsing on first launch. Every file is validated on the way by
+// CompileAsset itself, and problems are reported as path:line: messages. Built by `make compiler`.
+//
+// Compiled as one translation unit with loader.cpp, so files are indexed and compiled by exactly the
+// code the game runs.
+#include "../src/loader.cpp"
+
+#include <cstdio>
+#include <set>
+
+namespace {
+
+struct CompilerOptions {
+    fs::path input;
+    fs::path output;
+    // Only validate, don't write anything.
+    bool check = false;
+    // Write LZ4-compressed packs.
+    bool compress = false;
+};
+
+struct CompiledFile {
+    std::vector<AssetDiagnostic> diagnostics;
+    std::vector<uint8_t> binary;
+    bool compiled = false;
+};
+
+// One asset folder, compiled and checked but not written yet.
+struct CompiledFolder {
+    const AssetFormat* format = nullptr;
+    bool present = false;
+    std::vector<CompiledFile> results;
+    // The files without errors, by text ID.
+    std::vector<std::pair<int32_t, const std::vector<uint8_t>*>> loaded;
+};
+
+// Validates and compiles one asset folder into folder, reporting every problem CompileAsset finds.
+// Returns the number of errors.
+size_t CompileFolder(const AssetFormat& format, const CompilerOptions& options, CompiledFolder& folder, size_t& warnings) {
+    folder.format = &format;
+    fs::path folderPath = GetFolderPath(options.input, format);
+    std::error_code ec;
+    if (!fs::is_directory(folderPath, ec)) return 0;
+    folder.present = true;
+
+    auto start = std::chrono::steady_clock::now();
+    // Only the folder itself; overlays are the game's business, not part of what gets shipped.
+    AssetIndex index = BuildAssetIndex(format, std::vector<AssetLayer>{ AssetLayer{ folderPath, 0 } });
+    std::vector<std::pair<int32_t, IndexedFile>> files(index.files.begin(), index.files.end());
+    std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<CompiledFile>& results = folder.results;
+    results.resize(files.size());
+    GetThreadPool().ParallelFor(files.size(), [&](size_t i) {
+        CompiledFile& result = results[i];
+        std::string contents;
+        try {
+            ReadDialogFile(files[i].second.path.string(), contents);
+            CompileAsset(contents, format, result.binary, &result.diagnostics);
+            result.compiled = true;
+        } catch (const std::exception& e) {
+            result.diagnostics.push_back(AssetDiagnostic{ 0, true, e.what() });
+        }
+    });
+
+    size_t errors = 0;
+    std::set<std::vector<uint8_t>> distinct;
+    size_t bytes = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        CompiledFile& result = results[i];
+        std::stable_sort(result.diagnostics.begin(), result.diagnostics.end(), [](const AssetDiagnostic& a, const AssetDiagnostic& b) {
+            return a.line < b.line;
+        });
+        bool failed = !result.compiled;
+        for (const AssetDiagnostic& diagnostic : result.diagnostics) {
+            std::string location = files[i].second.path.string();
+            if (diagnostic.line > 0) location += ":" + std::to_string(diagnostic.line);
+            fprintf(stderr, "%s: %s: %s\n", location.c_str(), diagnostic.error ? "error" : "warning", diagnostic.message.c_str());
+            (diagnostic.error ? errors : warnings)++;
+            failed |= diagnostic.error;
+        }
+        if (failed) continue;
+
+        folder.loaded.emplace_back(files[i].first, &result.binary);
+        bytes += result.binary.size();
+        distinct.insert(result.binary);
+    }
+
+    size_t distinctBytes = 0;
+    for (const std::vector<uint8_t>& binary : distinct) distinctBytes += binary.size();
+    printf("%s: compiled %zu/%zu files in %.2f ms, %zu distinct (%zu of %zu bytes)\n", format.folder, folder.loaded.size(),
+        files.size(), NsToMs(ElapsedNs(start)), distinct.size(), distinctBytes, bytes);
+    return errors;
+}
+
+// Writes the .prebuilt.pack of a folder that compiled without errors. Returns false if it can't.
+bool WritePack(const CompiledFolder& folder, const CompilerOptions& options) {
+    fs::path packPath = GetPrebuiltPackPath(options.output, *folder.format);
+    if (!DialogPack::Write(packPath, 0, folder.loaded, options.compress)) {
+        fprintf(stderr, "%s: error: cannot write the pack\n", packPath.string().c_str());
+        return false;
+    }
+    std::error_code ec;
+    printf("%s: wrote %ju bytes\n", packPath.string().c_str(), uintmax_t(fs::file_size(packPath, ec)));
+    return true;
+}
+
+void PrintUsage() {
+    printf("usage: dialog_compiler FOLDER [--output DIR] [--check] [--compress]\n"
+        "  Compiles FOLDER/dialog, FOLDER/quiz_q and FOLDER/grunty_q into <kind>.prebuilt.pack files in DIR\n"
+        "  (FOLDER by default). With --check, only reports problems. Nothing is written if there are errors.\n"
+        "  With --compress, entries are stored LZ4-compressed.\n");
+}
+
+bool ParseOptions(int argc, char** argv, CompilerOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--check") {
+            options.check = true;
+        } else if (option == "--compress") {
+            options.compress = true;
+        } else if (option == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (option.compare(0, 2, "--") != 0 && options.input.empty()) {
+            options.input = option;
+        } else {
+            return false;
+        }
+    }
+    if (options.output.empty()) options.output = options.input;
+    return !options.input.empty();
+}
+
+}
+
+int main(int argc, char** argv) {
+    CompilerOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 2;
+    }
+
+    std::error_code ec;
+    if (!fs::is_directory(options.input, ec)) {
+        fprintf(stderr, "%s: error: not a folder\n", options.input.string().c_str());
+        return 2;
+    }
+    if (!options.check) {
+        fs::create_directories(options.output, ec);
+    }
+
+    // Every folder is checked before any pack is written, so an error in one kind doesn't leave the
+    // others' packs from this run next to a stale one.
+    size_t errors = 0;
+    size_t warnings = 0;
+    std::array<CompiledFolder, std::size(assetLoaders)> folders;
+    for (size_t i = 0; i < folders.size(); i++) {
+        errors += CompileFolder(assetLoaders[i]->format, options, folders[i], warnings);
+    }
+
+    if (!options.check && errors == 0) {
+        for (const CompiledFolder& folder : folders) {
+            if (folder.present && !WritePack(folder, options)) errors++;
+        }
+    }
+
+    printf("%zu error(s), %zu warning(s)\n", errors, warnings);
+    return errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,360 @@
+// Turns compiled text back into the .dialog, .quiz_q and .grunty_q files it was compiled from, for
+// translations that only ship a .prebuilt.pack or assets taken out of the game. Reads a language
+// folder (one with dialog/, quiz_q/ and grunty_q/ in it, like DialogLoader/): every entry of its
+// .prebuilt.pack and .pack files, and every raw binary named <text ID>.bin in its asset folders,
+// in the game's byte order or the ROM's. Decompiling is the exact inverse of CompileAsset, which
+// --verify checks by compiling every result again. Built by `make decompiler`.
+//
+// It doesn't read ROMs: finding the text in the ROM's asset table and inflating it is left to the
+// extraction page linked from the README or the decomp's asset tools, whose output it takes as .bin
+// files.
+//
+// Compiled as one translation unit with loader.cpp, so results are verified with exactly the code
+// the game runs. Tests define DIALOG_DECOMPILER_NO_MAIN to include it without its main.
+#include "../src/loader.cpp"
+
+#include <cstdio>
+#include <map>
+
+namespace {
+
+struct DecompilerOptions {
+    fs::path input;
+    // Nothing is written when empty.
+    fs::path output;
+    // Compile every result again and compare it with the binary it came from.
+    bool verify = false;
+};
+
+// QuizQuestion and GruntyQuestion binaries have one count for the question and its answers; the
+// game shows the last three entries as the options.
+constexpr size_t OPTION_COUNT = 3;
+
+// One compiled asset.
+struct Binary {
+    int32_t textId;
+    // Where it was read from, for messages.
+    std::string source;
+    // In guest byte order and padded to whole words, like CompileAsset writes it.
+    std::vector<uint8_t> bytes;
+};
+
+struct DecompiledFile {
+    std::string contents;
+    // Bytes of the binary the entries take up, with their padding. Anything past it is zeros.
+    size_t length = 0;
+    std::string error;
+    bool verified = false;
+};
+
+struct Entry {
+    uint8_t cmd;
+    std::string_view text;
+};
+
+std::string FormatTextId(int32_t textId) {
+    char text[16];
+    snprintf(text, sizeof(text), "%04X", textId);
+    return text;
+}
+
+bool HasHeader(const std::vector<uint8_t>& bytes, const AssetFormat& format) {
+    return bytes.size() > format.header.size() && std::equal(format.header.begin(), format.header.end(), bytes.begin());
+}
+
+// Adds every entry of the pack at packPath to binaries. Returns the number of errors.
+size_t ReadPack(const fs::path& packPath, std::map<int32_t, Binary>& binaries) {
+    std::error_code ec;
+    if (!fs::exists(packPath, ec)) return 0;
+    DialogPack pack;
+    if (!pack.Open(packPath)) {
+        fprintf(stderr, "%s: error: not a pack\n", packPath.string().c_str());
+        return 1;
+    }
+
+    size_t errors = 0;
+    for (size_t i = 0; i < pack.GetEntryCount(); i++) {
+        int32_t textId = pack.GetTextId(i);
+        Binary binary{ textId, packPath.string() + ":" + FormatTextId(textId), {} };
+        binary.bytes.resize(pack.Read(textId, nullptr, UINT32_MAX));
+        if (binary.bytes.empty() || pack.Read(textId, binary.bytes.data(), uint32_t(binary.bytes.size())) != binary.bytes.size()) {
+            fprintf(stderr, "%s: error: entry doesn't decompress\n", binary.source.c_str());
+            errors++;
+            continue;
+        }
+        binaries[textId] = std::move(binary);
+    }
+    return errors;
+}
+
+// Reads a raw binary into guest byte order, padded to whole words. Assets taken from the ROM start
+// with the format's header, ones dumped from the game's memory with its words swapped.
+bool ReadRawBinary(const fs::path& filePath, const AssetFormat& format, std::vector<uint8_t>& bytes) {
+    std::ifstream file(filePath, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (file.bad()) return false;
+    bytes.resize((bytes.size() + 3) & ~size_t(3), 0);
+
+    std::vector<uint8_t> swapped = bytes;
+    SwapWords(swapped.data(), swapped.size());
+    if (HasHeader(bytes, format)) {
+        bytes.swap(swapped);
+        return true;
+    }
+    return HasHeader(swapped, format);
+}
+
+// Everything under input to decompile for format, by text ID. Raw binaries replace pack entries
+// and the .pack replaces the .prebuilt.pack, the same way files take precedence in the loader.
+// Returns the number of errors.
+size_t CollectBinaries(const AssetFormat& format, const fs::path& input, std::map<int32_t, Binary>& binaries) {
+    size_t errors = ReadPack(GetPrebuiltPackPath(input, format), binaries);
+    errors += ReadPack(GetPackPath(input, format), binaries);
+
+    fs::path folderPath = GetFolderPath(input, format);
+    std::error_code ec;
+    if (!fs::is_directory(folderPath, ec)) return errors;
+    for (const auto& entry : fs::recursive_directory_iterator(folderPath, ec)) {
+        if (!entry.is_regular_file(ec) || entry.path().extension() != ".bin") continue;
+        int32_t textId;
+        if (!ParseTextId(entry.path(), textId)) continue;
+
+        Binary binary{ textId, entry.path().string(), {} };
+        if (!ReadRawBinary(entry.path(), format, binary.bytes)) {
+            fprintf(stderr, "%s: error: not a %s binary\n", binary.source.c_str(), format.type);
+            errors++;
+            continue;
+        }
+        binaries[textId] = std::move(binary);
+    }
+    return errors;
+}
+
+void AppendLatin1AsUTF8(std::string_view text, std::string& out) {
+    for (char c : text) {
+        uint8_t byte = uint8_t(c);
+        if (byte < 0x80) {
+            out += c;
+        } else {
+            out += char(0xC0 | (byte >> 6));
+            out += char(0x80 | (byte & 0x3F));
+        }
+    }
+}
+
+// Writes a section header and its entries the way the decomp project does. Fails if a string can't
+// be written so that CompileAsset reads it back: entries are one line each, and strings can't
+// escape their quotes.
+bool WriteSection(const char* header, const std::vector<Entry>& entries, std::string& out, std::string& error) {
+    out += header;
+    out += '\n';
+    for (size_t i = 0; i < entries.size(); i++) {
+        std::string_view text = entries[i].text;
+        if (text.find('\n') != std::string_view::npos) {
+            error = std::string(header) + " entry " + std::to_string(i) + " has a line break, which the format can't hold";
+            return false;
+        }
+        char quote = text.find('"') == std::string_view::npos ? '"' : '\'';
+        if (text.find(quote) != std::string_view::npos) {
+            error = std::string(header) + " entry " + std::to_string(i) + " has both kinds of quotes, which the format can't hold";
+            return false;
+        }
+
+        char cmd[32];
+        snprintf(cmd, sizeof(cmd), "  - { cmd: 0x%02x, string: ", entries[i].cmd);
+        out += cmd;
+        out += quote;
+        AppendLatin1AsUTF8(text, out);
+        out += quote;
+        out += " }\n";
+    }
+    return true;
+}
+
+// The inverse of CompileAsset: swaps the words back, reads the entries of each section and writes
+// them as text. Fails, with error set, if the binary is malformed or has something the text format
+// can't hold, so that whatever it returns compiles back to the same bytes.
+bool DecompileAsset(const std::vector<uint8_t>& binary, const AssetFormat& format, DecompiledFile& result) {
+    std::vector<uint8_t> data = binary;
+    SwapWords(data.data(), data.size());
+    if (!HasHeader(data, format)) {
+        result.error = std::string("not a ") + format.type;
+        return false;
+    }
+
+    size_t position = format.header.size();
+    auto readEntries = [&](size_t count, std::vector<Entry>& entries) {
+        for (size_t i = 0; i < count; i++) {
+            if (data.size() - position < 2) {
+                result.error = "entry " + std::to_string(entries.size()) + " is cut off";
+                return false;
+            }
+            uint8_t cmd = data[position];
+            size_t length = data[position + 1];
+            if (length == 0 || data.size() - position - 2 < length || data[position + 1 + length] != 0) {
+                result.error = "entry " + std::to_string(entries.size()) + " has no null terminator within its length";
+                return false;
+            }
+            entries.push_back(Entry{ cmd, std::string_view(reinterpret_cast<const char*>(data.data()) + position + 2, length - 1) });
+            position += length + 2;
+        }
+        return true;
+    };
+    auto readCount = [&](size_t& count) {
+        if (position >= data.size()) {
+            result.error = "count is cut off";
+            return false;
+        }
+        count = data[position++];
+        return true;
+    };
+
+    std::array<std::vector<Entry>, 2> sections;
+    size_t count;
+    if (format.sharedCount) {
+        if (!readCount(count) || !readEntries(count, sections[0])) return false;
+        size_t options = count > OPTION_COUNT ? OPTION_COUNT : 0;
+        sections[1].assign(sections[0].end() - options, sections[0].end());
+        sections[0].resize(count - options);
+    } else {
+        for (std::vector<Entry>& section : sections) {
+            if (!readCount(count) || !readEntries(count, section)) return false;
+        }
+    }
+
+    result.length = (position + 3) & ~size_t(3);
+    if (std::any_of(data.begin() + position, data.end(), [](uint8_t byte) { return byte != 0; })) {
+        result.error = std::to_string(data.size() - position) + " bytes after the entries aren't padding";
+        return false;
+    }
+
+    result.contents = std::string("type: ") + format.type + "\n";
+    return WriteSection(format.sections[0], sections[0], result.contents, result.error) &&
+        WriteSection(format.sections[1], sections[1], result.contents, result.error);
+}
+
+// Compiles result again and checks that it gives back binary, up to the padding after the entries.
+void VerifyAsset(const std::vector<uint8_t>& binary, const AssetFormat& format, DecompiledFile& result) {
+    std::vector<uint8_t> compiled;
+    try {
+        CompileAsset(result.contents, format, compiled);
+    } catch (const std::exception& e) {
+        result.error = std::string("doesn't compile back: ") + e.what();
+        return;
+    }
+    if (compiled.size() != result.length) {
+        result.error = "compiles back to " + std::to_string(compiled.size()) + " bytes instead of " + std::to_string(result.length);
+        return;
+    }
+    auto difference = std::mismatch(compiled.begin(), compiled.end(), binary.begin());
+    if (difference.first != compiled.end()) {
+        result.error = "compiles back differently from byte " + std::to_string(difference.first - compiled.begin());
+        return;
+    }
+    result.verified = true;
+}
+
+void PrintUsage() {
+    printf("usage: dialog_decompiler FOLDER [--output DIR] [--verify]\n"
+        "  Decompiles every entry of the <kind>.prebuilt.pack and <kind>.pack files in FOLDER, and every\n"
+        "  FOLDER/<kind>/**/<text ID>.bin, into DIR/<kind>/<text ID>.<kind> files. Without --output,\n"
+        "  nothing is written. With --verify, every result is compiled again and compared with its binary.\n");
+}
+
+bool ParseOptions(int argc, char** argv, DecompilerOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--verify") {
+            options.verify = true;
+        } else if (option == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (option.compare(0, 2, "--") != 0 && options.input.empty()) {
+            options.input = option;
+        } else {
+            return false;
+        }
+    }
+    return !options.input.empty();
+}
+
+}
+
+#ifndef DIALOG_DECOMPILER_NO_MAIN
+
+int main(int argc, char** argv) {
+    DecompilerOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 2;
+    }
+
+    std::error_code ec;
+    if (!fs::is_directory(options.input, ec)) {
+        fprintf(stderr, "%s: error: not a folder\n", options.input.string().c_str());
+        return 2;
+    }
+
+    // Every kind in one list, so the pool decompiles them all at once.
+    std::vector<std::pair<const AssetFormat*, Binary>> binaries;
+    size_t errors = 0;
+    for (AssetLoader* loader : assetLoaders) {
+        std::map<int32_t, Binary> found;
+        errors += CollectBinaries(loader->format, options.input, found);
+        for (auto& [textId, binary] : found) {
+            binaries.emplace_back(&loader->format, std::move(binary));
+        }
+        if (!options.output.empty() && !found.empty()) {
+            fs::create_directories(GetFolderPath(options.output, loader->format), ec);
+        }
+    }
+
+    size_t bytes = 0;
+    for (const auto& [format, binary] : binaries) bytes += binary.bytes.size();
+
+    std::vector<DecompiledFile> results(binaries.size());
+    auto start = std::chrono::steady_clock::now();
+    GetThreadPool().ParallelFor(binaries.size(), [&](size_t i) {
+        const AssetFormat& format = *binaries[i].first;
+        DecompiledFile& result = results[i];
+        if (!DecompileAsset(binaries[i].second.bytes, format, result) || options.output.empty()) return;
+
+        fs::path filePath = GetFolderPath(options.output, format) / (FormatTextId(binaries[i].second.textId) + format.extension);
+        std::ofstream file(filePath, std::ios::binary);
+        file << result.contents;
+        if (!file) result.error = "cannot write " + filePath.string();
+    });
+    int64_t decompileNs = ElapsedNs(start);
+
+    int64_t verifyNs = 0;
+    if (options.verify) {
+        start = std::chrono::steady_clock::now();
+        GetThreadPool().ParallelFor(binaries.size(), [&](size_t i) {
+            if (results[i].error.empty()) VerifyAsset(binaries[i].second.bytes, *binaries[i].first, results[i]);
+        });
+        verifyNs = ElapsedNs(start);
+    }
+
+    size_t decompiled = 0;
+    size_t verified = 0;
+    for (size_t i = 0; i < binaries.size(); i++) {
+        if (!results[i].error.empty()) {
+            fprintf(stderr, "%s: error: %s\n", binaries[i].second.source.c_str(), results[i].error.c_str());
+            errors++;
+            continue;
+        }
+        decompiled++;
+        if (results[i].verified) verified++;
+    }
+
+    double seconds = std::max<int64_t>(decompileNs, 1) / 1e9;
+    printf("%s %zu/%zu binaries (%zu bytes) in %.2f ms on %zu threads: %.1f MB/s, %.0f binaries/s\n",
+        options.output.empty() ? "decompiled" : "decompiled and wrote", decompiled, binaries.size(), bytes, NsToMs(decompileNs),
+        GetThreadPool().GetThreadCount(), bytes / seconds / 1e6, binaries.size() / seconds);
+    if (options.verify) {
+        printf("verified %zu/%zu round trips in %.2f ms\n", verified, binaries.size(), NsToMs(verifyNs));
+    }
+    printf("%zu error(s)\n", errors);
+    return errors > 0 ? 1 : 0;
+}
+
+#endif